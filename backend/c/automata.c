@@ -0,0 +1,856 @@
+/*
+  automata.c
+
+  See automata.h.
+*/
+
+#define _POSIX_C_SOURCE 200809L /* fstat, mmap, fdopen, fmemopen, open_memstream */
+
+#include "automata.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+/* ===== binary .dfa ===== */
+
+static uint32_t get_u32(const unsigned char* p){
+    return (uint32_t)p[0] | (uint32_t)p[1]<<8 | (uint32_t)p[2]<<16 | (uint32_t)p[3]<<24;
+}
+
+static void put_u32(unsigned char* p, uint32_t v){
+    p[0]=(unsigned char)v; p[1]=(unsigned char)(v>>8); p[2]=(unsigned char)(v>>16); p[3]=(unsigned char)(v>>24);
+}
+
+static size_t pad4(size_t n){ return (n+3) & ~(size_t)3; }
+
+int dfab_is_binary(const void* p, size_t len){
+    return len>=4 && memcmp(p,DFAB_MAGIC,4)==0;
+}
+
+int dfab_accepting(const DfabView* v, int s){
+    return (v->accept[s>>3] >> (s&7)) & 1;
+}
+
+uint32_t dfab_trans(const DfabView* v, size_t i){
+    const unsigned char* p=v->trans + i*(size_t)v->width;
+    switch(v->width){
+        case 1: return p[0];
+        case 2: return (uint32_t)p[0] | (uint32_t)p[1]<<8;
+        default: return get_u32(p);
+    }
+}
+
+void dfab_row(const DfabView* v, int s, uint32_t* out){
+    const size_t k=(size_t)v->k;
+    const unsigned char* p=v->trans + (size_t)s*k*(size_t)v->width;
+    switch(v->width){
+        case 1: for(size_t a=0;a<k;a++) out[a]=p[a]; break;
+        case 2: for(size_t a=0;a<k;a++) out[a]=(uint32_t)p[2*a] | (uint32_t)p[2*a+1]<<8; break;
+        default: for(size_t a=0;a<k;a++) out[a]=get_u32(p+4*a); break;
+    }
+}
+
+const char* dfab_parse(const void* data, size_t len, DfabView* v){
+    const unsigned char* p=(const unsigned char*)data;
+    memset(v,0,sizeof(*v));
+    if(len<DFAB_HEADER_SIZE || !dfab_is_binary(p,len)) return "bad binary DFA: missing header";
+    if(((unsigned)p[4] | (unsigned)p[5]<<8) != DFAB_VERSION) return "bad binary DFA: unsupported version";
+
+    uint32_t width=p[6], k=get_u32(p+8), n=get_u32(p+12), start=get_u32(p+16), m=get_u32(p+20);
+    if(width!=1 && width!=2 && width!=4) return "bad binary DFA: state id width";
+    if(k==0 || k>256) return "bad binary DFA: alphabet size range";
+    if(n==0 || n>(uint32_t)INT32_MAX) return "bad binary DFA: states must be positive";
+    if(start>=n) return "bad binary DFA: start out of range";
+    if(m>n) return "bad binary DFA: accept count range";
+    if(width<4 && n-1 > ((uint32_t)1<<(8*width))-1) return "bad binary DFA: state id width too narrow";
+
+    size_t off_alpha=DFAB_HEADER_SIZE;
+    size_t off_acc=off_alpha+pad4(k);
+    size_t off_trans=off_acc+pad4(((size_t)n+7)/8);
+    size_t cells=(size_t)n*(size_t)k;
+    if(cells/k != n || cells > (SIZE_MAX-off_trans)/width) return "bad binary DFA: table too large";
+    if(len < off_trans+cells*width) return "bad binary DFA: truncated";
+
+    v->k=(int)k; v->n=(int)n; v->start=(int)start; v->width=(int)width; v->n_accept=(int)m;
+    v->alphabet=p+off_alpha;
+    v->accept=p+off_acc;
+    v->trans=p+off_trans;
+
+    uint32_t seen=0;
+    for(uint32_t s=0;s<n;s++) seen+=(uint32_t)dfab_accepting(v,(int)s);
+    if(seen!=m) return "bad binary DFA: accept count does not match bitmap";
+    for(size_t i=0;i<cells;i++) if(dfab_trans(v,i)>=n) return "bad binary DFA: transition out of range";
+    return NULL;
+}
+
+int dfab_write(FILE* out, int k, const char* alphabet, int n, int start,
+               const unsigned char* acc, const int* trans){
+    return dfab_write_classes(out,k,alphabet,n,start,acc,trans,k,NULL);
+}
+
+int dfab_write_classes(FILE* out, int k, const char* alphabet, int n, int start,
+                       const unsigned char* acc, const int* trans, int nclass, const unsigned char* cls){
+    const int width = n<=256 ? 1 : n<=65536 ? 2 : 4;
+    unsigned char hdr[DFAB_HEADER_SIZE]={0};
+    int m=0;
+    for(int s=0;s<n;s++) if(acc[s]) m++;
+    memcpy(hdr,DFAB_MAGIC,4);
+    hdr[4]=DFAB_VERSION; hdr[5]=0;
+    hdr[6]=(unsigned char)width;
+    put_u32(hdr+8,(uint32_t)k);
+    put_u32(hdr+12,(uint32_t)n);
+    put_u32(hdr+16,(uint32_t)start);
+    put_u32(hdr+20,(uint32_t)m);
+    if(fwrite(hdr,1,sizeof(hdr),out)!=sizeof(hdr)) return -1;
+
+    static const unsigned char zero[4]={0};
+    if(fwrite(alphabet,1,(size_t)k,out)!=(size_t)k) return -1;
+    if(fwrite(zero,1,pad4((size_t)k)-(size_t)k,out)!=pad4((size_t)k)-(size_t)k) return -1;
+
+    unsigned char byte=0;
+    for(int s=0;s<n;s++){
+        if(acc[s]) byte|=(unsigned char)(1u<<(s&7));
+        if((s&7)==7 || s==n-1){
+            if(fputc(byte,out)==EOF) return -1;
+            byte=0;
+        }
+    }
+    size_t nb=((size_t)n+7)/8;
+    if(fwrite(zero,1,pad4(nb)-nb,out)!=pad4(nb)-nb) return -1;
+
+    unsigned char row[4*256];
+    for(int s=0;s<n;s++){
+        const int* tr=&trans[(size_t)s*(size_t)nclass];
+        for(int a=0;a<k;a++){
+            uint32_t t=(uint32_t)tr[cls ? cls[a] : a];
+            unsigned char* p=row+(size_t)a*(size_t)width;
+            if(width==1) p[0]=(unsigned char)t;
+            else if(width==2){ p[0]=(unsigned char)t; p[1]=(unsigned char)(t>>8); }
+            else put_u32(p,t);
+        }
+        if(fwrite(row,(size_t)width,(size_t)k,out)!=(size_t)k) return -1;
+    }
+    return 0;
+}
+
+/* ===== whole DFAs ===== */
+
+/* Row s of one of the two tables: trans, or v's ids of 1, 2 or 4 bytes when trans is NULL. */
+static const uint32_t* table_row(const int* trans, const DfabView* v, int k, int s, uint32_t* buf){
+    if(trans){
+        const int* r=&trans[(size_t)s*(size_t)k];
+        for(int a=0;a<k;a++) buf[a]=(uint32_t)r[a];
+    } else {
+        dfab_row(v,s,buf);
+    }
+    return buf;
+}
+
+static uint32_t table_cell(const int* trans, const DfabView* v, size_t i){
+    return trans ? (uint32_t)trans[i] : dfab_trans(v,i);
+}
+
+static int symbol_classes(int n, int k, const int* trans, const DfabView* v, unsigned char* cls){
+    /* one pass over the rows hashes every column, symbols with equal hashes are put in
+       one class and a second pass checks that their columns are equal */
+    uint64_t h[DFA_MAX_ALPHABET];
+    int first[DFA_MAX_ALPHABET];       /* class -> its first symbol */
+    uint32_t buf[DFA_MAX_ALPHABET];
+    for(int a=0;a<k;a++) h[a]=1469598103934665603ULL;
+    for(int s=0;s<n;s++){
+        const uint32_t* row=table_row(trans,v,k,s,buf);
+        for(int a=0;a<k;a++) h[a]=(h[a]^row[a])*1099511628211ULL;
+    }
+    int nclass=0;
+    for(int a=0;a<k;a++){
+        int c=0;
+        while(c<nclass && h[first[c]]!=h[a]) c++;
+        if(c==nclass) first[nclass++]=a;
+        cls[a]=(unsigned char)c;
+    }
+    int equal=1;
+    for(int s=0;s<n && equal && nclass<k;s++){
+        const uint32_t* row=table_row(trans,v,k,s,buf);
+        for(int a=0;a<k;a++) if(row[a]!=row[first[cls[a]]]) equal=0;
+    }
+    if(equal) return nclass;
+
+    /* two different columns hashed alike: compare column by column */
+    nclass=0;
+    for(int a=0;a<k;a++){
+        int c=0;
+        for(;c<nclass;c++){
+            int b=first[c];
+            if(h[b]!=h[a]) continue;
+            int s=0;
+            while(s<n && table_cell(trans,v,(size_t)s*(size_t)k+(size_t)a)==table_cell(trans,v,(size_t)s*(size_t)k+(size_t)b)) s++;
+            if(s==n) break;
+        }
+        if(c==nclass) first[nclass++]=a;
+        cls[a]=(unsigned char)c;
+    }
+    return nclass;
+}
+
+int dfa_symbol_classes(int n, int k, const int* trans, unsigned char* cls){
+    return symbol_classes(n,k,trans,NULL,cls);
+}
+
+int dfab_symbol_classes(const DfabView* v, unsigned char* cls){
+    return symbol_classes(v->n,v->k,NULL,v,cls);
+}
+
+void dfa_table_free(DfaTable* t){
+    free(t->alphabet);
+    free(t->acc);
+    free(t->trans);
+    memset(t,0,sizeof(*t));
+}
+
+static const char* expect_token(FILE* f, const char* tok){
+    char buf[64];
+    if(fscanf(f,"%63s",buf)!=1) return "unexpected EOF while reading DFA";
+    if(strcmp(buf,tok)!=0) return "bad DFA format: unexpected header token";
+    return NULL;
+}
+
+/* Fills *t in place; the caller frees it on failure. */
+static const char* dfa_text_read(FILE* f, DfaTable* t){
+    const char* err;
+    if((err=expect_token(f,"ALPHABET"))) return err;
+    if(fscanf(f,"%d",&t->k)!=1) return "bad DFA format: alphabet size";
+    if(t->k<=0 || t->k>DFA_MAX_ALPHABET) return "bad DFA format: alphabet size range";
+    t->alphabet=(char*)malloc((size_t)t->k+1);
+    if(!t->alphabet) return "out of memory";
+
+    // read the alphabet string (no spaces)
+    char alphbuf[1024];
+    if(fscanf(f,"%1023s",alphbuf)!=1) return "bad DFA format: alphabet string";
+    if((int)strlen(alphbuf)!=t->k) return "bad DFA format: alphabet string length mismatch";
+    memcpy(t->alphabet,alphbuf,(size_t)t->k);
+    t->alphabet[t->k]='\0';
+
+    if((err=expect_token(f,"STATES"))) return err;
+    if(fscanf(f,"%d",&t->n)!=1) return "bad DFA format: states";
+    if(t->n<=0) return "bad DFA format: states must be positive";
+
+    if((err=expect_token(f,"START"))) return err;
+    if(fscanf(f,"%d",&t->start)!=1) return "bad DFA format: start";
+    if(t->start<0 || t->start>=t->n) return "bad DFA format: start out of range";
+
+    if((err=expect_token(f,"ACCEPT"))) return err;
+    int m=0;
+    if(fscanf(f,"%d",&m)!=1) return "bad DFA format: accept count";
+    if(m<0 || m>t->n) return "bad DFA format: accept count range";
+    t->acc=(unsigned char*)calloc((size_t)t->n,1);
+    if(!t->acc) return "out of memory";
+    for(int i=0;i<m;i++){
+        int a=0;
+        if(fscanf(f,"%d",&a)!=1) return "bad DFA format: accept list";
+        if(a<0 || a>=t->n) return "bad DFA format: accepting state out of range";
+        t->acc[a]=1;
+    }
+
+    if((err=expect_token(f,"TRANS"))) return err;
+    t->trans=(int*)malloc((size_t)t->n*(size_t)t->k*sizeof(int));
+    if(!t->trans) return "out of memory";
+    for(int s=0;s<t->n;s++){
+        for(int a=0;a<t->k;a++){
+            int x=0;
+            if(fscanf(f,"%d",&x)!=1) return "bad DFA format: transition table";
+            if(x<0 || x>=t->n) return "bad DFA format: transition out of range";
+            t->trans[(size_t)s*(size_t)t->k+(size_t)a]=x;
+        }
+    }
+
+    return expect_token(f,"END");
+}
+
+/* Binary .dfa: header checks are done by dfab_parse; the table stays in the view. */
+static const char* dfa_from_binary(const DfabView* v, DfaTable* t){
+    if(v->k>DFA_MAX_ALPHABET) return "bad DFA format: alphabet size range";
+    t->k=v->k;
+    t->n=v->n;
+    t->start=v->start;
+    t->alphabet=(char*)malloc((size_t)t->k+1);
+    t->acc=(unsigned char*)malloc((size_t)t->n);
+    if(!t->alphabet || !t->acc) return "out of memory";
+    memcpy(t->alphabet,v->alphabet,(size_t)t->k);
+    t->alphabet[t->k]='\0';
+    if(strlen(t->alphabet)!=(size_t)t->k) return "bad DFA format: alphabet string length mismatch";
+    for(int s=0;s<t->n;s++) t->acc[s]=(unsigned char)dfab_accepting(v,s);
+    return NULL;
+}
+
+/* A binary table is widened into t->trans here. */
+const char* dfa_table_load(const void* p, size_t len, DfaTable* t){
+    DfabView v;
+    const char* err=dfa_table_load_view(p,len,t,&v);
+    if(!err && !t->trans){
+        size_t cells=(size_t)t->n*(size_t)t->k;
+        t->trans=(int*)malloc(cells*sizeof(int));
+        if(!t->trans){ dfa_table_free(t); return "out of memory"; }
+        for(size_t i=0;i<cells;i++) t->trans[i]=(int)dfab_trans(&v,i);
+    }
+    return err;
+}
+
+const char* dfa_table_load_view(const void* p, size_t len, DfaTable* t, DfabView* v){
+    const char* err;
+    memset(t,0,sizeof(*t));
+    memset(v,0,sizeof(*v));
+    if(dfab_is_binary(p,len)){
+        err=dfab_parse(p,len,v);
+        if(!err) err=dfa_from_binary(v,t);
+    } else {
+        static char empty[1];
+        FILE* f=fmemopen(len ? (void*)p : empty,len,"r");
+        if(!f) return "cannot open in-memory stream";
+        err=dfa_text_read(f,t);
+        fclose(f);
+    }
+    if(err) dfa_table_free(t);
+    return err;
+}
+
+/* ===== minimization ===== */
+
+const char* dfa_reachable(int n, int k, const int* trans, int start, int* id, int* reach_n){
+    int* q=(int*)malloc((size_t)n*sizeof(int));
+    if(!q) return "out of memory";
+    for(int s=0;s<n;s++) id[s]=-1;
+    int qh=0, qt=0;
+    id[start]=qt;
+    q[qt++]=start;
+    while(qh<qt){
+        int s=q[qh++];
+        for(int a=0;a<k;a++){
+            int t=trans[(size_t)s*k+a];
+            if(id[t]<0){ id[t]=qt; q[qt++]=t; }
+        }
+    }
+    free(q);
+    *reach_n=qt;
+    return NULL;
+}
+
+/* dfa_minimize's work arrays live in one buffer per thread that is kept between calls,
+   so minimizing DFAs one after another does not allocate; a buffer grown past
+   MIN_WORK_KEEP_BYTES is released after the call instead. Per thread in every build,
+   as regex2mindfa's Compilers may minimize on several threads at once. */
+#define MIN_WORK_KEEP_BYTES ((size_t)32<<20)
+
+static _Thread_local void* min_work=NULL;
+static _Thread_local size_t min_work_cap=0;
+
+static void* min_work_reserve(size_t bytes){
+    if(bytes>min_work_cap){
+        free(min_work);
+        min_work_cap=bytes;
+        min_work=malloc(bytes);
+        if(!min_work) min_work_cap=0;
+    }
+    return min_work;
+}
+
+static void min_work_trim(void){
+    if(min_work_cap>MIN_WORK_KEEP_BYTES){
+        free(min_work);
+        min_work=NULL;
+        min_work_cap=0;
+    }
+}
+
+/*
+  Hopcroft's algorithm on a refinable partition. The states of block b occupy
+  elems[first[b] .. end[b]); loc[s] is the index of s in elems and blk[s] its block.
+  Marking a state swaps it to the front of its block, so the marked part of b is
+  elems[first[b] .. first[b]+marked[b]) and a split is O(marked). W is a stack of
+  blocks still to be used as splitters, in_w[b] flags membership.
+*/
+const char* dfa_minimize(int n, int k, const int* trans, const unsigned char* acc, int start,
+                         int* cls, int* min_n, DfaMinStats* st){
+    DfaMinStats local;
+    if(!st) st=&local;
+    st->pops=st->splits=0;
+
+    int nF=0;
+    for(int s=0;s<n;s++) if(acc[s]) nF++;
+    int nNF=n-nF;
+    if(nF==0 || nNF==0){
+        for(int s=0;s<n;s++) cls[s]=0;
+        *min_n=1;
+        return NULL;
+    }
+
+    /* predecessors of q on a: inv_to[inv_off[a*n+q] .. inv_off[a*n+q+1]) */
+    size_t NK=(size_t)n*(size_t)k;
+    int* ws=(int*)min_work_reserve((3*NK+1+10*(size_t)n)*sizeof(int));
+    if(!ws) return "out of memory";
+    int* inv_off =ws;
+    int* inv_to  =inv_off+NK+1;
+    int* fill    =inv_to+NK;
+    int* elems   =fill+NK;
+    int* loc     =elems+n;
+    int* blk     =loc+n;
+    int* first   =blk+n;
+    int* end     =first+n;
+    int* marked  =end+n;
+    int* in_w    =marked+n;
+    int* W       =in_w+n;
+    int* touched =W+n;
+    int* splitter=touched+n;
+    memset(inv_off,0,(NK+1)*sizeof(int));
+    memset(marked,0,(size_t)n*sizeof(int));
+    memset(in_w,0,(size_t)n*sizeof(int));
+
+    for(int p=0;p<n;p++) for(int a=0;a<k;a++) inv_off[(size_t)a*n+trans[(size_t)p*k+a]+1]++;
+    for(size_t i=0;i<NK;i++) inv_off[i+1]+=inv_off[i];
+    memcpy(fill,inv_off,NK*sizeof(int));
+    for(int p=0;p<n;p++) for(int a=0;a<k;a++) inv_to[fill[(size_t)a*n+trans[(size_t)p*k+a]]++]=p;
+
+    /* block 0 = accepting, block 1 = non-accepting */
+    int Pn=2, Wn=0, pos=0;
+    first[0]=0;
+    for(int s=0;s<n;s++) if(acc[s]){ elems[pos]=s; loc[s]=pos++; blk[s]=0; }
+    end[0]=first[1]=pos;
+    for(int s=0;s<n;s++) if(!acc[s]){ elems[pos]=s; loc[s]=pos++; blk[s]=1; }
+    end[1]=pos;
+
+    W[Wn]=(nF<=nNF)?0:1; in_w[W[Wn++]]=1;
+
+    while(Wn>0){
+        int B=W[--Wn];
+        in_w[B]=0;
+        st->pops++;
+        /* B may itself be split below; refine by its contents at pop time */
+        int sn=0;
+        for(int i=first[B];i<end[B];i++) splitter[sn++]=elems[i];
+        if(steps_spend((long)sn*k)){
+            min_work_trim();
+            return "step budget exceeded";
+        }
+
+        for(int a=0;a<k;a++){
+            int nt=0;
+            for(int i=0;i<sn;i++){
+                const int* po=&inv_off[(size_t)a*n+splitter[i]];
+                for(int j=po[0];j<po[1];j++){
+                    int p=inv_to[j];
+                    int b=blk[p], m=first[b]+marked[b], at=loc[p];
+                    if(at<m) continue;
+                    int o=elems[m];
+                    elems[m]=p;  loc[p]=m;
+                    elems[at]=o; loc[o]=at;
+                    if(marked[b]++==0) touched[nt++]=b;
+                }
+            }
+
+            for(int ti=0;ti<nt;ti++){
+                int b=touched[ti];
+                int m=marked[b];
+                marked[b]=0;
+                if(first[b]+m==end[b]) continue;
+
+                int nb=Pn++;
+                st->splits++;
+                first[nb]=first[b];
+                end[nb]=first[b]+m;
+                first[b]=end[nb];
+                for(int i=first[nb];i<end[nb];i++) blk[elems[i]]=nb;
+
+                if(in_w[b]){
+                    W[Wn++]=nb; in_w[nb]=1;
+                } else {
+                    int small=(end[nb]-first[nb] <= end[b]-first[b]) ? nb : b;
+                    W[Wn++]=small; in_w[small]=1;
+                }
+            }
+        }
+    }
+
+    /* renumber blocks in BFS order from the start state's block */
+    int* order=marked; /* all zero again; reuse as block -> class+1 */
+    int* q=W;
+    int qh=0, qt=0, c=0;
+    order[blk[start]]=++c;
+    q[qt++]=blk[start];
+    while(qh<qt){
+        int b=q[qh++];
+        int r=elems[first[b]];
+        for(int a=0;a<k;a++){
+            int tb=blk[trans[(size_t)r*k+a]];
+            if(!order[tb]){ order[tb]=++c; q[qt++]=tb; }
+        }
+    }
+    for(int b=0;b<Pn;b++) if(!order[b]) order[b]=++c;
+    for(int s=0;s<n;s++) cls[s]=order[blk[s]]-1;
+    *min_n=c;
+
+    min_work_trim();
+    return NULL;
+}
+
+/* ===== tests files ===== */
+
+#ifndef TR_WINDOW
+#define TR_WINDOW (64u<<10)   /* first inflate window; doubled for longer lines */
+#endif
+
+const char* test_reader_open(TestReader* r, const void* p, size_t len){
+    memset(r,0,sizeof(*r));
+    r->src=(const unsigned char*)p;
+    r->src_len=len;
+    if(len<2 || r->src[0]!=0x1f || r->src[1]!=0x8b){
+        r->p=(const char*)p;
+        r->end=r->p+len;
+        return NULL;
+    }
+    z_stream* zs=(z_stream*)calloc(1,sizeof(z_stream));
+    r->win=(char*)malloc(TR_WINDOW);
+    if(!zs || !r->win){ free(zs); test_reader_close(r); return "out of memory"; }
+    if(inflateInit2(zs,15+16)!=Z_OK){ free(zs); test_reader_close(r); return "cannot initialise gzip decoder"; }
+    r->z=zs;
+    r->win_cap=TR_WINDOW;
+    r->p=r->end=r->win;
+    return NULL;
+}
+
+void test_reader_close(TestReader* r){
+    if(r->z){
+        inflateEnd((z_stream*)r->z);
+        free(r->z);
+    }
+    free(r->win);
+    memset(r,0,sizeof(*r));
+}
+
+/* Moves the unread text to the front of the window and inflates after it until the
+   window is full or the data ends. */
+static const char* tr_fill(TestReader* r){
+    z_stream* zs=(z_stream*)r->z;
+    size_t keep=(size_t)(r->end-r->p);
+    memmove(r->win,r->p,keep);
+    if(keep==r->win_cap){
+        char* nw=(char*)realloc(r->win,r->win_cap*2);
+        if(!nw) return "out of memory";
+        r->win=nw;
+        r->win_cap*=2;
+    }
+    size_t have=keep;
+    while(have<r->win_cap && !r->z_done){
+        if(zs->avail_in==0 && r->src_off<r->src_len){
+            size_t n=r->src_len-r->src_off;
+            if(n>(1u<<30)) n=1u<<30;
+            zs->next_in=(Bytef*)(r->src+r->src_off);
+            zs->avail_in=(uInt)n;
+            r->src_off+=n;
+        }
+        size_t room=r->win_cap-have;
+        if(room>(1u<<30)) room=1u<<30;
+        zs->next_out=(Bytef*)(r->win+have);
+        zs->avail_out=(uInt)room;
+        int rc=inflate(zs,Z_NO_FLUSH);
+        have+=room-zs->avail_out;
+        if(rc==Z_STREAM_END){
+            /* concatenated gzip members are one file */
+            if(zs->avail_in>0 || r->src_off<r->src_len){
+                if(inflateReset(zs)!=Z_OK) return "corrupt gzip tests file";
+            } else {
+                r->z_done=1;
+            }
+        } else if(rc==Z_BUF_ERROR && zs->avail_in==0 && r->src_off>=r->src_len){
+            return "truncated gzip tests file";
+        } else if(rc!=Z_OK && rc!=Z_BUF_ERROR){
+            return "corrupt gzip tests file";
+        }
+    }
+    r->p=r->win;
+    r->end=r->win+have;
+    return NULL;
+}
+
+/* One line, [p, e) without its newline. Returns 1 for a test, 0 to skip, -1 if malformed. */
+static int parse_test_line(const char* p, const char* e, int* label, const char** w, size_t* wlen, const char** err){
+    // skip empty/comment
+    while(p<e && isspace((unsigned char)*p)) p++;
+    if(p==e || *p=='#') return 0;
+
+    // label is first token
+    if(*p!='0' && *p!='1'){
+        *err="label must be 0 or 1";
+        return -1;
+    }
+    *label = (*p=='1') ? 1 : 0;
+    p++;
+    while(p<e && isspace((unsigned char)*p)) p++;
+    if(p==e){
+        *err="missing string token (use <eps> for empty)";
+        return -1;
+    }
+
+    // the string is the next token (no spaces inside strings)
+    const char* q=p;
+    while(q<e && !isspace((unsigned char)*q)) q++;
+    *w=p;
+    *wlen = (q-p==5 && memcmp(p,"<eps>",5)==0) ? 0 : (size_t)(q-p);
+    return 1;
+}
+
+int test_reader_next(TestReader* r, int* label, const char** w, size_t* wlen, const char** err){
+    for(;;){
+        const char* nl = r->p<r->end ? (const char*)memchr(r->p,'\n',(size_t)(r->end-r->p)) : NULL;
+        if(!nl && r->z && !r->z_done){
+            if((*err=tr_fill(r))) return -2;
+            continue;
+        }
+        if(!nl && r->p==r->end) return 0;
+
+        const char* line=r->p;
+        const char* e = nl ? nl : r->end;
+        r->p = nl ? nl+1 : r->end;
+        r->line_no++;
+        int rc=parse_test_line(line,e,label,w,wlen,err);
+        if(rc!=0) return rc;
+    }
+}
+
+/* ===== file mapping ===== */
+
+/* Descriptor named by path: 0/1 for "-", N for /dev/fd/N, -1 for a plain path */
+static int stream_fd(const char* path, int out){
+    if(strcmp(path,"-")==0) return out ? 1 : 0;
+    if(strncmp(path,"/dev/fd/",8)!=0 || !isdigit((unsigned char)path[8])) return -1;
+    char* end;
+    long fd=strtol(path+8,&end,10);
+    return *end || fd>1000000 ? -1 : (int)fd;
+}
+
+static const char* read_stream(int fd, MappedFile* m){
+    size_t cap=1<<16;
+    char* buf=malloc(cap);
+    if(!buf) return "out of memory";
+    for(;;){
+        if(m->len==cap){
+            char* nb = cap>SIZE_MAX/2 ? NULL : realloc(buf,cap*2);
+            if(!nb){ free(buf); return "out of memory"; }
+            buf=nb;
+            cap*=2;
+        }
+        ssize_t r=read(fd,buf+m->len,cap-m->len);
+        if(r==0) break;
+        if(r<0){
+            if(errno==EINTR) continue;
+            free(buf);
+            m->len=0;
+            return "cannot read file";
+        }
+        m->len+=(size_t)r;
+    }
+    if(m->len==0){ free(buf); return NULL; }
+    m->data=buf;
+    m->heap=1;
+    return NULL;
+}
+
+const char* map_file(const char* path, MappedFile* m){
+    m->data=NULL;
+    m->len=0;
+    m->heap=0;
+    int fd=stream_fd(path,0);
+    const int named = fd<0;
+    if(named) fd=open(path,O_RDONLY);
+    if(fd<0) return "cannot open file";
+    struct stat st;
+    const char* err=NULL;
+    if(fstat(fd,&st)!=0) err="cannot stat file";
+    else if(!S_ISREG(st.st_mode)) err=read_stream(fd,m);
+    else if(st.st_size>0){
+        void* p=mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        if(p==MAP_FAILED) err="cannot map file";
+        else {
+            m->data=p;
+            m->len=(size_t)st.st_size;
+        }
+    }
+    if(named) close(fd);
+    return err;
+}
+
+void unmap_file(MappedFile* m){
+    if(m->heap) free(m->data);
+    else if(m->data) munmap(m->data,m->len);
+    m->data=NULL;
+    m->len=0;
+    m->heap=0;
+}
+
+FILE* open_stream(const char* path, const char* mode){
+    const int out = mode[0]!='r';
+    int fd=stream_fd(path,out);
+    if(fd==0 && !out) return stdin;
+    if(fd==1 && out) return stdout;
+    return fd<0 ? fopen(path,mode) : fdopen(fd,mode);
+}
+
+int close_stream(FILE* f){
+    if(f==stdin) return 0;
+    if(f==stdout) return fflush(f)==0 && !ferror(f) ? 0 : -1;
+    return fclose(f);
+}
+
+/* ===== in-process requests ===== */
+
+/* The step budget is the calling thread's in every build, like dfa_minimize's buffer. */
+static _Thread_local long steps_left=-1;   /* < 0: unlimited */
+static _Thread_local long steps_given=0;
+static _Thread_local int steps_out=0;
+
+void steps_begin(long budget){
+    steps_left = budget>0 ? budget : -1;
+    steps_given = budget>0 ? budget : 0;
+    steps_out=0;
+}
+
+long steps_limit(void){
+    return steps_given;
+}
+
+int steps_spend(long n){
+    if(steps_left<0) return 0;
+    steps_left -= n;
+    if(steps_left<0){
+        steps_left=0;
+        steps_out=1;
+    }
+    return steps_out;
+}
+
+int steps_exhausted(void){
+    return steps_out;
+}
+
+static const char* find_flag(const char* flags, const char* name){
+    const size_t n=strlen(name);
+    for(const char* p=flags; (p=strstr(p,name)); p+=n){
+        if((p==flags || p[-1]==' ') && (p[n]=='\0' || p[n]==' ')) return p+n;
+    }
+    return NULL;
+}
+
+int has_flag(const char* flags, const char* name){
+    return find_flag(flags,name)!=NULL;
+}
+
+long flag_long(const char* flags, const char* name, long dflt){
+    const char* p=find_flag(flags,name);
+    if(!p || *p!=' ') return dflt;
+    char* e=NULL;
+    long v=strtol(p+1,&e,10);
+    return e==p+1 ? dflt : v;
+}
+
+/* ===== serving requests ===== */
+
+static int serve_run(const ServeTool* t, char** fields, const size_t* lens, FILE* fin, FILE* fout, FILE* ferr){
+    if(!t->die_jmp) return t->run(t->ctx,fields,lens,fin,fout,ferr);
+    jmp_buf jb;
+    *t->err_out=ferr;
+    *t->die_jmp=&jb;
+    int code;
+    if(setjmp(jb)!=0){
+        t->unwind(t->ctx);
+        code = steps_exhausted() ? STEPS_EXCEEDED_EXIT : 1;
+    } else {
+        code=t->run(t->ctx,fields,lens,fin,fout,ferr);
+    }
+    *t->die_jmp=NULL;
+    *t->err_out=NULL;
+    return code;
+}
+
+/* Reads one request header and its nf fields: 1, 0 on clean EOF, -1 with *err set. */
+static int read_request(char** fields, size_t* lens, int nf, const char** err){
+    char hdr[256];
+    if(!fgets(hdr,sizeof(hdr),stdin)) return 0;
+    char* p=hdr;
+    for(int i=0;i<nf;i++){
+        char* e=NULL;
+        unsigned long long v=strtoull(p,&e,10);
+        if(e==p){ *err="serve: bad request header"; return -1; }
+        lens[i]=(size_t)v;
+        p=e;
+    }
+    for(int i=0;i<nf;i++){
+        free(fields[i]);
+        fields[i]=(char*)malloc(lens[i]+1);
+        if(!fields[i]){ *err="out of memory"; return -1; }
+        if(fread(fields[i],1,lens[i],stdin)!=lens[i]){ *err="serve: truncated request"; return -1; }
+        fields[i][lens[i]]='\0';
+    }
+    return 1;
+}
+
+static void write_response(int code, const char* out, size_t out_len, const char* err, size_t err_len){
+    fprintf(stdout,"%d %zu %zu\n",code,out_len,err_len);
+    fwrite(out,1,out_len,stdout);
+    fwrite(err,1,err_len,stdout);
+    fflush(stdout);
+}
+
+#define SERVE_MAX_FIELDS 5
+
+const char* serve_requests(const ServeTool* t){
+    char* fields[SERVE_MAX_FIELDS]={NULL};
+    size_t lens[SERVE_MAX_FIELDS];
+    const char* err=NULL;
+    int r;
+    while((r=read_request(fields,lens,t->nf,&err))>0){
+        char *out=NULL, *errs=NULL;
+        size_t on=0, en=0;
+        FILE* fin = t->fin_field>=0 ? fmemopen(fields[t->fin_field],lens[t->fin_field],"r") : NULL;
+        FILE* fout=open_memstream(&out,&on);
+        FILE* ferr=open_memstream(&errs,&en);
+        if((t->fin_field>=0 && !fin) || !fout || !ferr){
+            if(fin) fclose(fin);
+            if(fout) fclose(fout);
+            if(ferr) fclose(ferr);
+            free(out); free(errs);
+            err="serve: cannot open in-memory streams";
+            break;
+        }
+
+        int code=serve_run(t,fields,lens,fin,fout,ferr);
+
+        if(fin) fclose(fin);
+        fclose(fout); fclose(ferr);
+        write_response(code,out,on,errs,en);
+        free(out); free(errs);
+    }
+    for(int i=0;i<t->nf;i++) free(fields[i]);
+    return err;
+}
+
+#ifdef GRADER_LIBRARY
+
+int serve_call(const ServeTool* t, char** fields, const size_t* lens, ToolOutput* o){
+    memset(o,0,sizeof(*o));
+    FILE* fin = t->fin_field>=0 ? fmemopen(fields[t->fin_field],lens[t->fin_field],"r") : NULL;
+    FILE* fout=open_memstream(&o->out,&o->out_len);
+    FILE* ferr=open_memstream(&o->err,&o->err_len);
+    int code=1;
+    if((t->fin_field<0 || fin) && fout && ferr) code=serve_run(t,fields,lens,fin,fout,ferr);
+    if(fin) fclose(fin);
+    if(fout) fclose(fout);
+    if(ferr) fclose(ferr);
+    return code;
+}
+
+#endif
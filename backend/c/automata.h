@@ -0,0 +1,228 @@
+/*
+  automata.h
+
+  PURPOSE
+    Code shared by the C tools: .dfa loading (text and binary), the binary writer,
+    DFA minimization, tests file lines, read-only file mapping and the --serve framing.
+    Functions report failure by returning an error message (NULL on success), so
+    each tool can hand it to its own die().
+
+  BINARY .dfa FORMAT ("DFAB", version 1, integers little-endian)
+    offset  size
+    0       4     magic "DFAB"
+    4       2     version
+    6       1     width: bytes per state id in the table, 1, 2 or 4 (narrowest that holds n-1)
+    7       1     reserved, 0
+    8       4     k, alphabet size
+    12      4     n, number of states
+    16      4     start state
+    20      4     number of accepting states
+    24      k     alphabet bytes, zero padded to a multiple of 4
+    ...     ceil(n/8) accept bitmap (state s is bit s%8 of byte s/8), zero padded to a multiple of 4
+    ...     n*k*width transition table, row-major, row s = state s
+
+    The text format stays the default; tools write this one with --binary, and every
+    reader accepts either (a file starting with the magic is binary).
+
+  COMPILE
+    Link automata.c and zlib into every tool, e.g.
+      gcc -O2 -Wall -Wextra -std=c11 dfa_checker.c automata.c -lz -o dfa_checker
+    backend/native builds regex2mindfa, dfa2table and dfa_checker together with
+    -DGRADER_LIBRARY as a Node addon (see "in-process requests" below).
+*/
+#ifndef AUTOMATA_H
+#define AUTOMATA_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+#define DFAB_MAGIC "DFAB"
+#define DFAB_VERSION 1
+#define DFAB_HEADER_SIZE 24
+
+/* A validated binary DFA; the pointers alias the parsed buffer. */
+typedef struct {
+    int k, n, start, width, n_accept;
+    const unsigned char* alphabet; /* k bytes, not NUL terminated */
+    const unsigned char* accept;   /* bitmap */
+    const unsigned char* trans;    /* n*k ids of width bytes */
+} DfabView;
+
+int dfab_is_binary(const void* p, size_t len);
+const char* dfab_parse(const void* p, size_t len, DfabView* v);
+int dfab_accepting(const DfabView* v, int s);
+uint32_t dfab_trans(const DfabView* v, size_t i);
+/* The k ids of row s (state s) into out. */
+void dfab_row(const DfabView* v, int s, uint32_t* out);
+
+/* acc has n entries (nonzero = accepting), trans n*k. Returns 0, or -1 on a write error. */
+int dfab_write(FILE* out, int k, const char* alphabet, int n, int start,
+               const unsigned char* acc, const int* trans);
+/* dfab_write() from a table with one column per symbol class (see dfa_symbol_classes):
+   trans is n*nclass and symbol a reads column cls[a]. */
+int dfab_write_classes(FILE* out, int k, const char* alphabet, int n, int start,
+                       const unsigned char* acc, const int* trans, int nclass, const unsigned char* cls);
+
+/* ===== whole DFAs ===== */
+#define DFA_MAX_ALPHABET 128
+
+typedef struct {
+    int k;              /* alphabet size */
+    char* alphabet;     /* string length k */
+    int n;              /* states */
+    int start;
+    unsigned char* acc; /* length n: 0/1 */
+    int* trans;         /* n*k, row-major */
+} DfaTable;
+
+/* Symbol classes of an n*k table (k <= DFA_MAX_ALPHABET): symbols whose columns are
+   equal in every state step alike, so a table needs one column per class only.
+   cls[a] (k entries) receives the class of symbol a, classes numbered in order of
+   their first symbol; returns the number of classes. */
+int dfa_symbol_classes(int n, int k, const int* trans, unsigned char* cls);
+/* dfa_symbol_classes() of a binary DFA's table, read in place. */
+int dfab_symbol_classes(const DfabView* v, unsigned char* cls);
+
+/* A .dfa file held in memory, text or binary. On failure *t is left empty. */
+const char* dfa_table_load(const void* p, size_t len, DfaTable* t);
+/* dfa_table_load() that leaves a binary file's table where it is: t->trans stays NULL
+   and *v views the table (v->trans is NULL for a text file, whose table is in t). */
+const char* dfa_table_load_view(const void* p, size_t len, DfaTable* t, DfabView* v);
+void dfa_table_free(DfaTable* t);
+
+/* ===== minimization =====
+   trans is a complete n*k table (every entry a state), acc has n entries. */
+
+/* id[s] = BFS number of s from start (symbols in alphabet order), -1 if unreachable;
+   *reach_n = number of reachable states. */
+const char* dfa_reachable(int n, int k, const int* trans, int start, int* id, int* reach_n);
+
+typedef struct { long pops, splits; } DfaMinStats; /* Hopcroft splitter pops and block splits */
+
+/* Hopcroft minimization: cls[s] (n entries) is the class of s and *min_n the number of
+   classes. Classes are numbered in BFS order from start's class (symbols in alphabet
+   order), so equal languages always produce the same table; classes holding only
+   unreachable states come last. st may be NULL. The work arrays are kept per thread
+   between calls, so repeated minimizations of similar size do not allocate. */
+const char* dfa_minimize(int n, int k, const int* trans, const unsigned char* acc, int start,
+                         int* cls, int* min_n, DfaMinStats* st);
+
+/* ===== tests files =====
+   Each non-empty, non-comment line is "<label> <string>", label 0 or 1, with <eps>
+   for the empty string; lines starting with # are comments.
+
+   A TestReader walks a tests file held in memory (a mapped file or a serve field)
+   and returns each test as pointers into that memory: nothing is copied and lines
+   may be any length. A file starting with the gzip magic is inflated block by block
+   into a window that grows to fit the longest line. */
+typedef struct {
+    const unsigned char* src;  /* the file as given */
+    size_t src_len, src_off;   /* src_off: compressed bytes handed to zlib so far */
+    const char* p;             /* unread text: p .. end */
+    const char* end;
+    char* win;                 /* inflated text, gzip only */
+    size_t win_cap;
+    void* z;                   /* z_stream, gzip only */
+    int z_done;
+    int line_no;               /* line of the test (or error) last returned */
+} TestReader;
+
+const char* test_reader_open(TestReader* r, const void* p, size_t len);
+/* Returns 1 for a test: *label, and *w / *wlen (wlen 0 for <eps>, w not NUL terminated,
+   valid until the next call). Returns 0 at end of file, -1 for a malformed line
+   (r->line_no, message in *err) and -2 for corrupt gzip data (message in *err). */
+int test_reader_next(TestReader* r, int* label, const char** w, size_t* wlen, const char** err);
+void test_reader_close(TestReader* r);
+
+/* ===== file mapping ===== */
+
+/* Paths given to the tools may also name a stream: "-" is stdin (stdout for an
+   output) and /dev/fd/N is descriptor N, used directly because a socket inherited
+   from the server cannot be reopened through /dev/fd. */
+
+/* Whole file mapped read-only; an empty file maps to data == NULL, len == 0.
+   A pipe, socket or other stream is read to EOF into a heap buffer instead. */
+typedef struct { void* data; size_t len; int heap; } MappedFile;
+
+const char* map_file(const char* path, MappedFile* m);
+void unmap_file(MappedFile* m);
+
+/* fopen() that also accepts the stream names above; close with close_stream(),
+   which leaves stdin and stdout open (flushing stdout) and reports write errors. */
+FILE* open_stream(const char* path, const char* mode);
+int close_stream(FILE* f);
+
+/* ===== in-process requests =====
+   Built with -DGRADER_LIBRARY the grader tools have no main(); each exports a
+   <tool>_call() that runs one request of its SERVE PROTOCOL on the calling thread.
+   TOOL_LOCAL marks the file-scope state of dfa2table and dfa_checker, which is then
+   per thread, and regex2mindfa compiles in a Compiler (regex2mindfa.h) of its own, so
+   calls on different threads share nothing but dfa_checker's editor sessions, which
+   it locks. regex2mindfa's --threads workers run within the call.
+   flags are the tool's command line flags, space separated ("--stats --minimize");
+   fields are NUL terminated and may be modified. The call fills o with its stdout
+   and stderr (malloc'd, the caller frees both) and returns the exit code. An error
+   unwinds to the call, which frees what the request held; nothing exits the process.
+
+   A step budget bounds a call's work instead of a kill timeout: steps_begin() sets
+   it for the calling thread (0 = unlimited, the default), the tools charge their
+   hot loops with steps_spend(), and a call that runs out fails with
+   "Error: step budget exceeded" and exit code STEPS_EXCEEDED_EXIT. A step is one
+   NFA set word stepped on one symbol in the subset construction (or for a lazy DFA
+   transition in regex2mindfa --check), one state of a splitter on one symbol in
+   dfa_minimize(), one test (per 32 bytes) in the checker and in --check, and one
+   symbol of a state pair in --equiv, all similar in cost. regex2mindfa's
+   other --max-* budgets exit with the same code. */
+#define STEPS_EXCEEDED_EXIT 124
+
+void steps_begin(long budget);
+/* The budget given to steps_begin(), 0 for none. */
+long steps_limit(void);
+/* Returns 1 once the calling thread's budget is used up. */
+int steps_spend(long n);
+int steps_exhausted(void);
+
+/* 1 when the space separated word list flags contains name. */
+int has_flag(const char* flags, const char* name);
+/* The number after name in flags ("--max-dfa-states 1000"), dflt when absent. */
+long flag_long(const char* flags, const char* name, long dflt);
+
+/* ===== serving requests =====
+   The framing of each tool's SERVE PROTOCOL: a request is a header line of nf field
+   lengths followed by the fields' bytes, a response "<code> <stdout_len> <stderr_len>\n"
+   followed by the two outputs. A ServeTool runs one request: run() gets the fields
+   (fin reads field fin_field, NULL when fin_field < 0) and writes to fout and ferr.
+   With die_jmp set, run() is called with *die_jmp and *err_out pointing here and at
+   ferr, so that the tool's die() unwinds back; unwind() then frees what the request
+   held and the exit code is STEPS_EXCEEDED_EXIT if the step budget ran out, else 1.
+   Tools that catch their own errors leave die_jmp NULL. */
+typedef struct {
+    int nf, fin_field;
+    int (*run)(void* ctx, char** fields, const size_t* lens, FILE* fin, FILE* fout, FILE* ferr);
+    void (*unwind)(void* ctx);
+    void* ctx;
+    jmp_buf** die_jmp;
+    FILE** err_out;
+} ServeTool;
+
+/* Answers requests on stdin until EOF (NULL), or returns the error that stopped it. */
+const char* serve_requests(const ServeTool* t);
+
+#ifdef GRADER_LIBRARY
+#define TOOL_LOCAL _Thread_local
+
+typedef struct { char* out; size_t out_len; char* err; size_t err_len; } ToolOutput;
+
+/* One request from fields into o, the body of each <tool>_call(). */
+int serve_call(const ServeTool* t, char** fields, const size_t* lens, ToolOutput* o);
+
+int regex2mindfa_call(const char* flags, char** fields, const size_t* lens, ToolOutput* o); /* input; --check: input, ref, tests */
+int dfa2table_call(const char* flags, char** fields, const size_t* lens, ToolOutput* o);    /* alphabet, spec */
+int dfa_checker_call(const char* flags, char** fields, const size_t* lens, ToolOutput* o);  /* opts, key, ref, user, tests */
+#else
+#define TOOL_LOCAL
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+/*
+  bench_compiler.c
+
+  PURPOSE
+    Time the regex2mindfa pipeline on a generated corpus of pathological regexes and
+    print one JSON object per case, so performance changes can be measured and
+    regressions caught.
+
+  CORPUS (families, each at several sizes)
+    tail_n         (a|b)*a(a|b)^n                  minimal DFA has 2^(n+1) states
+    counter_n      ((a|b)^n)*                      counting modulo n
+    nested_star_d  ((((a*b)*a)*b)* ...)*           d levels of nested stars
+    star_stack_d   ((((a)*)*)*)* ...               d stars applied to one symbol
+    eps_chain_n    (a|<eps>)^n a^n                 long epsilon chains in the NFA
+    union_n        w1|w2|...|wn                    n random 8-symbol words over abcd
+    star_union_n   (w1|w2|...|wn)*
+    wide_tail_n    (s1|...|s62)*s1(s1|...|s62)^n   62-symbol alphabet
+
+    Regexes stay under 4000 bytes, the limit the server puts on user regexes.
+
+  OUTPUT (one line per case, stdout)
+    {"case":"tail_10","family":"tail","size":10,"regex_len":..,"status":"ok",
+     "parse_ms":..,"nfa_ms":..,"dfa_ms":..,"min_ms":..,"write_ms":..,"total_ms":..,
+     "nfa_states":..,"dfa_states":..,"min_states":..,"peak_rss_kb":..}
+    With --glushkov every case is compiled through the position automaton instead of
+    the Thompson NFA; --threads N runs the subset construction on N threads. Stage times are the fastest of --repeat runs. status is "ok", "error" (the
+    compiler rejected the input, its message is on stderr) or "timeout".
+    Every case runs in a forked child, so peak_rss_kb is that case's own peak.
+
+  COMPILE
+    gcc -O2 -Wall -Wextra -std=c11 -pthread -DREGEX2MINDFA_NO_MAIN bench_compiler.c regex2mindfa_compiler.c automata.c -lz -o bench_compiler
+
+  RUN
+    ./bench_compiler [--repeat N] [--filter SUBSTR] [--timeout SEC] [--glushkov] [--threads N] [--list]
+*/
+
+#define _POSIX_C_SOURCE 200809L /* fmemopen */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "regex2mindfa.h"
+
+#define MAX_REGEX 4000
+
+static CompilerOptions opt;
+
+static void die(const char* msg){
+    fprintf(stderr,"Error: %s\n",msg);
+    exit(1);
+}
+static void* xrealloc(void* p,size_t n){ void* q=realloc(p,n); if(!q) die("out of memory"); return q; }
+
+/* ===== corpus ===== */
+
+typedef struct {
+    char name[64];
+    const char* family;
+    int size;
+    char* input;        /* "<regex>\n<alphabet>\n" */
+} BenchCase;
+
+static BenchCase* cases=NULL;
+static int n_cases=0, cap_cases=0;
+
+typedef struct { char* s; size_t n, cap; } Buf;
+
+static void buf_add(Buf* b, const char* t){
+    size_t m=strlen(t);
+    if(b->n+m+1 > b->cap){
+        size_t cap = b->cap ? b->cap : 256;
+        while(cap < b->n+m+1) cap*=2;
+        b->s=(char*)xrealloc(b->s,cap);
+        b->cap=cap;
+    }
+    memcpy(b->s+b->n,t,m+1);
+    b->n+=m;
+}
+
+static void buf_rep(Buf* b, const char* t, int times){
+    for(int i=0;i<times;i++) buf_add(b,t);
+}
+
+/* Takes ownership of rx->s; cases over MAX_REGEX are dropped. */
+static void add_case(const char* family, int size, Buf* rx, const char* alphabet){
+    if(rx->n > MAX_REGEX){ free(rx->s); return; }
+    if(n_cases==cap_cases){
+        cap_cases = cap_cases ? cap_cases*2 : 64;
+        cases=(BenchCase*)xrealloc(cases,(size_t)cap_cases*sizeof(BenchCase));
+    }
+    BenchCase* c=&cases[n_cases++];
+    snprintf(c->name,sizeof(c->name),"%s_%d",family,size);
+    c->family=family;
+    c->size=size;
+    Buf in={0};
+    buf_add(&in,rx->s);
+    buf_add(&in,"\n");
+    buf_add(&in,alphabet);
+    buf_add(&in,"\n");
+    c->input=in.s;
+    free(rx->s);
+}
+
+static unsigned long rng_state=12345;
+static unsigned rng(void){
+    rng_state = rng_state*6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned)(rng_state>>33);
+}
+
+static void random_words(Buf* rx, int n){
+    for(int i=0;i<n;i++){
+        char w[9];
+        for(int j=0;j<8;j++) w[j]="abcd"[rng()%4];
+        w[8]='\0';
+        if(i) buf_add(rx,"|");
+        buf_add(rx,w);
+    }
+}
+
+static void build_corpus(void){
+    static const char* wide="abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    for(int n=2;n<=14;n+=2){
+        Buf rx={0};
+        buf_add(&rx,"(a|b)*a");
+        buf_rep(&rx,"(a|b)",n);
+        add_case("tail",n,&rx,"ab");
+    }
+    for(int n=8;n<=256;n*=2){
+        Buf rx={0};
+        buf_add(&rx,"(");
+        buf_rep(&rx,"(a|b)",n);
+        buf_add(&rx,")*");
+        add_case("counter",n,&rx,"ab");
+    }
+    for(int d=4;d<=256;d*=4){
+        Buf rx={0};
+        buf_rep(&rx,"(",d);
+        buf_add(&rx,"a");
+        for(int i=0;i<d;i++) buf_add(&rx, (i&1) ? "*a)" : "*b)");
+        buf_add(&rx,"*");
+        add_case("nested_star",d,&rx,"ab");
+    }
+    for(int d=16;d<=1024;d*=4){
+        Buf rx={0};
+        buf_rep(&rx,"(",d);
+        buf_add(&rx,"a");
+        buf_rep(&rx,")*",d);
+        add_case("star_stack",d,&rx,"ab");
+    }
+    for(int n=25;n<=200;n*=2){
+        Buf rx={0};
+        buf_rep(&rx,"(a|<eps>)",n);
+        buf_rep(&rx,"a",n);
+        add_case("eps_chain",n,&rx,"a");
+    }
+    for(int n=50;n<=400;n*=2){
+        Buf rx={0};
+        random_words(&rx,n);
+        add_case("union",n,&rx,"abcd");
+    }
+    for(int n=25;n<=400;n*=2){
+        Buf rx={0};
+        buf_add(&rx,"(");
+        random_words(&rx,n);
+        buf_add(&rx,")*");
+        add_case("star_union",n,&rx,"abcd");
+    }
+    Buf any={0};
+    buf_add(&any,"(");
+    for(int i=0;wide[i];i++){
+        char s[3]={ wide[i], wide[i+1] ? '|' : ')', 0 };
+        buf_add(&any,s);
+    }
+    for(int n=1;n<=7;n+=2){
+        Buf rx={0};
+        buf_add(&rx,any.s);
+        buf_add(&rx,"*a");
+        buf_rep(&rx,any.s,n);
+        add_case("wide_tail",n,&rx,wide);
+    }
+    free(any.s);
+}
+
+/* ===== runner ===== */
+
+/* Runs in the forked child: compile c->input `repeat` times and print its JSON line. */
+static void run_case(const BenchCase* c, int repeat){
+    Compiler* C=compiler_new(&opt);
+    if(!C) die("out of memory");
+    CompilerStats st;
+    double best[5]; /* parse, nfa, dfa, min, write */
+
+    FILE* devnull=fopen("/dev/null","w");
+    if(!devnull) die("cannot open /dev/null");
+    for(int r=0;r<repeat;r++){
+        FILE* fin=fmemopen(c->input,strlen(c->input),"r");
+        if(!fin) die("cannot open in-memory stream");
+        if(compiler_compile(C,fin,stderr)!=0) exit(1);
+        fclose(fin);
+        if(compiler_write(C,devnull,stderr)!=0) exit(1);
+        compiler_stats(C,&st);
+        double ms[5]={ st.parse_ms, st.nfa_ms, st.dfa_ms, st.min_ms, st.write_ms };
+        for(int i=0;i<5;i++) if(r==0 || ms[i]<best[i]) best[i]=ms[i];
+    }
+    fclose(devnull);
+
+    double total=0;
+    for(int i=0;i<5;i++) total+=best[i];
+    struct rusage ru;
+    getrusage(RUSAGE_SELF,&ru);
+
+    printf("{\"case\":\"%s\",\"family\":\"%s\",\"size\":%d,\"regex_len\":%zu,\"status\":\"ok\","
+           "\"parse_ms\":%.3f,\"nfa_ms\":%.3f,\"dfa_ms\":%.3f,\"min_ms\":%.3f,\"write_ms\":%.3f,\"total_ms\":%.3f,"
+           "\"nfa_states\":%d,\"dfa_states\":%d,\"min_states\":%d,\"peak_rss_kb\":%ld}\n",
+           c->name,c->family,c->size,strcspn(c->input,"\n"),
+           best[0],best[1],best[2],best[3],best[4],total,
+           st.nfa_states,st.dfa_states,st.min_states,ru.ru_maxrss);
+    fflush(stdout);
+    compiler_free(C);
+}
+
+static void bench_case(const BenchCase* c, int repeat, int timeout_s){
+    fflush(stdout);
+    pid_t pid=fork();
+    if(pid<0) die("fork failed");
+    if(pid==0){
+        alarm((unsigned)timeout_s);
+        run_case(c,repeat);
+        _exit(0);
+    }
+    int st=0;
+    if(waitpid(pid,&st,0)<0) die("waitpid failed");
+    if(WIFEXITED(st) && WEXITSTATUS(st)==0) return;
+
+    const char* status = (WIFSIGNALED(st) && WTERMSIG(st)==SIGALRM) ? "timeout" : "error";
+    printf("{\"case\":\"%s\",\"family\":\"%s\",\"size\":%d,\"regex_len\":%zu,\"status\":\"%s\"}\n",
+           c->name,c->family,c->size,strcspn(c->input,"\n"),status);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv){
+    int repeat=3, timeout_s=20, list=0;
+    const char* filter=NULL;
+    compiler_options_default(&opt);
+    for(int i=1;i<argc;i++){
+        if(strcmp(argv[i],"--repeat")==0 && i+1<argc) repeat=atoi(argv[++i]);
+        else if(strcmp(argv[i],"--filter")==0 && i+1<argc) filter=argv[++i];
+        else if(strcmp(argv[i],"--timeout")==0 && i+1<argc) timeout_s=atoi(argv[++i]);
+        else if(strcmp(argv[i],"--glushkov")==0) opt.glushkov=1;
+        else if(strcmp(argv[i],"--threads")==0 && i+1<argc) opt.threads=atoi(argv[++i]);
+        else if(strcmp(argv[i],"--list")==0) list=1;
+        else {
+            fprintf(stderr,"Usage: %s [--repeat N] [--filter SUBSTR] [--timeout SEC] [--glushkov] [--threads N] [--list]\n",argv[0]);
+            return 1;
+        }
+    }
+    if(repeat<1) repeat=1;
+    if(timeout_s<1) timeout_s=1;
+
+    build_corpus();
+    for(int i=0;i<n_cases;i++){
+        const BenchCase* c=&cases[i];
+        if(filter && !strstr(c->name,filter)) continue;
+        if(list) printf("%s\n",c->name);
+        else bench_case(c,repeat,timeout_s);
+    }
+
+    for(int i=0;i<n_cases;i++) free(cases[i].input);
+    free(cases);
+    return 0;
+}
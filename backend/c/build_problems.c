@@ -0,0 +1,365 @@
+/*
+  build_problems.c
+
+  PURPOSE
+    Compile and sanity-check a whole problem set in one run: every <problems_dir>/<id>/
+    holding a ref.txt gets its reference DFA compiled and written to <out_dir>/<id>.dfa,
+    and every test in its tests.txt is run on that DFA to check that the label agrees
+    with the reference (the "WARNING: test label mismatch" case of dfa_checker).
+    Problems are built in parallel, one forked child each.
+
+  OUTPUT
+    stderr: the label mismatches, as dfa_checker words them, prefixed with the problem id
+      P001: WARNING: test label mismatch vs reference at line 4 (label=1, ref=0)
+    stdout: one JSON object per problem, in problem id order, then a summary line
+      {"problem":"P001","status":"ok","states":..,"tests":..,"label_mismatches":..,
+       "compile_ms":..,"check_ms":..,"total_ms":..,"peak_rss_kb":..}
+      {"summary":true,"problems":..,"ok":..,"errors":..,"timeouts":..,"label_mismatches":..,
+       "wall_ms":..,"jobs":..}
+    status is "ok", "error" (the message is in "error") or "timeout". A problem whose
+    tests disagree with its reference is still "ok"; only the count tells.
+    Exit code: 0 if every problem built with consistent labels, 2 if some label
+    disagrees, 1 if some problem failed.
+
+  ARTIFACTS
+    <out_dir>/<id>.dfa is the binary .dfa format (automata.h), --text writes the text
+    one. Each artifact is read back before its tests run, so the check sees exactly
+    what the grader will load.
+
+  COMPILE
+    gcc -O2 -Wall -Wextra -std=c11 -pthread -DREGEX2MINDFA_NO_MAIN build_problems.c regex2mindfa_compiler.c automata.c -lz -o build_problems
+
+  RUN
+    ./build_problems [--jobs N] [--timeout SEC] [--text] [--glushkov] <problems_dir> <out_dir>
+    --jobs defaults to the number of online CPUs, --timeout (per problem) to 60.
+*/
+
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, _SC_NPROCESSORS_ONLN */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "automata.h"
+#include "regex2mindfa.h"
+
+#define MAX_REPORTED 16   /* mismatch lines kept per problem for stderr */
+
+static CompilerOptions opt;
+
+/* In a child die() reports into the problem's error and unwinds to run_child. */
+static FILE* err_out=NULL;
+static jmp_buf* die_jmp=NULL;
+static FILE* errs(void){ return err_out ? err_out : stderr; }
+
+static void fail(void){
+    if(die_jmp) longjmp(*die_jmp,1);
+    exit(1);
+}
+static void die(const char* msg){
+    fprintf(errs(),"Error: %s\n",msg);
+    fail();
+}
+static void* xmalloc(size_t n){ void* p=malloc(n); if(!p) die("out of memory"); return p; }
+static void* xrealloc(void* p,size_t n){ void* q=realloc(p,n); if(!q) die("out of memory"); return q; }
+
+static double now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec*1e3 + (double)ts.tv_nsec/1e6;
+}
+
+/* ===== problems ===== */
+
+/* Filled in by the child in memory shared with the parent. */
+typedef struct {
+    char id[64];
+    int done;
+    int states, tests, mismatches;
+    int mismatch_line[MAX_REPORTED], mismatch_label[MAX_REPORTED];
+    double compile_ms, check_ms, total_ms;
+    long peak_rss_kb;
+    char error[256];
+} Problem;
+
+static Problem* probs=NULL;
+static int n_probs=0;
+
+static int cmp_id(const void* a, const void* b){
+    return strcmp(*(char* const*)a,*(char* const*)b);
+}
+
+static int file_exists(const char* path){
+    struct stat st;
+    return stat(path,&st)==0 && S_ISREG(st.st_mode);
+}
+
+/* Every subdirectory with a ref.txt, sorted by name, in a shared mapping. */
+static void find_problems(const char* dir){
+    DIR* d=opendir(dir);
+    if(!d) die("cannot open problems directory");
+    char** names=NULL;
+    int n=0, cap=0;
+    struct dirent* e;
+    char path[4096];
+    while((e=readdir(d))){
+        if(e->d_name[0]=='.' || strlen(e->d_name)>=sizeof(probs->id)) continue;
+        snprintf(path,sizeof(path),"%s/%s/ref.txt",dir,e->d_name);
+        if(!file_exists(path)) continue;
+        if(n==cap){
+            cap = cap ? cap*2 : 64;
+            names=(char**)xrealloc(names,(size_t)cap*sizeof(char*));
+        }
+        names[n]=(char*)xmalloc(strlen(e->d_name)+1);
+        strcpy(names[n++],e->d_name);
+    }
+    closedir(d);
+    if(n==0) die("no problems (subdirectories with a ref.txt) found");
+    qsort(names,(size_t)n,sizeof(char*),cmp_id);
+
+    void* p=mmap(NULL,(size_t)n*sizeof(Problem),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+    if(p==MAP_FAILED) die("cannot map shared results");
+    probs=(Problem*)p;
+    memset(probs,0,(size_t)n*sizeof(Problem));
+    for(int i=0;i<n;i++){
+        strcpy(probs[i].id,names[i]);
+        free(names[i]);
+    }
+    free(names);
+    n_probs=n;
+}
+
+/* ===== one problem (forked child) ===== */
+
+static const char* problems_dir=NULL;
+static const char* out_dir=NULL;
+
+static void trim_newline(char* s){
+    size_t n=strlen(s);
+    while(n>0 && (s[n-1]=='\n' || s[n-1]=='\r')) s[--n]='\0';
+}
+
+/* Runs every test of tests.txt on the reference; a bad line is an error. */
+static void check_labels(Problem* pr, const DfaTable* ref, const char* tests, size_t tests_len){
+    signed char col[256];
+    memset(col,-1,sizeof(col));
+    for(int i=0;i<ref->k;i++) col[(unsigned char)ref->alphabet[i]]=(signed char)i;
+
+    char msg[128];
+    TestReader reader;
+    const char* err=test_reader_open(&reader,tests,tests_len);
+    if(err) die(err);
+    for(;;){
+        int label=0;
+        const char* w=NULL;
+        size_t wlen=0;
+        int r=test_reader_next(&reader,&label,&w,&wlen,&err);
+        if(r==0) break;
+        int line_no=reader.line_no;
+        if(r==-2) die(err);
+        if(r<0){
+            snprintf(msg,sizeof(msg),"tests line %d: %s",line_no,err);
+            die(msg);
+        }
+
+        int s=ref->start;
+        for(size_t i=0;i<wlen;i++){
+            int a=col[(unsigned char)w[i]];
+            if(a<0){
+                snprintf(msg,sizeof(msg),"tests line %d: string contains symbol not in alphabet",line_no);
+                die(msg);
+            }
+            s=ref->trans[(size_t)s*(size_t)ref->k+(size_t)a];
+        }
+        pr->tests++;
+        if(ref->acc[s]!=label){
+            if(pr->mismatches<MAX_REPORTED){
+                pr->mismatch_line[pr->mismatches]=line_no;
+                pr->mismatch_label[pr->mismatches]=label;
+            }
+            pr->mismatches++;
+        }
+    }
+    test_reader_close(&reader);
+}
+
+static void build_one(Problem* pr){
+    char path[4096], out_path[4096];
+    double t0=now_ms();
+
+    Compiler* C=compiler_new(&opt);
+    if(!C) die("out of memory");
+
+    snprintf(path,sizeof(path),"%s/%s/ref.txt",problems_dir,pr->id);
+    FILE* fin=fopen(path,"r");
+    if(!fin) die("cannot open ref.txt");
+    if(compiler_compile(C,fin,errs())!=0) fail();
+    fclose(fin);
+
+    snprintf(out_path,sizeof(out_path),"%s/%s.dfa",out_dir,pr->id);
+    FILE* fout=fopen(out_path,opt.binary ? "wb" : "w");
+    if(!fout) die("cannot open output file for writing");
+    if(compiler_write(C,fout,errs())!=0) fail();
+    if(fclose(fout)!=0) die("cannot write output file");
+    compiler_free(C);
+    double t1=now_ms();
+
+    MappedFile m;
+    if(map_file(out_path,&m)) die("cannot read back the written DFA");
+    DfaTable ref;
+    const char* err=dfa_table_load(m.data,m.len,&ref);
+    unmap_file(&m);
+    if(err) die(err);
+    pr->states=ref.n;
+
+    snprintf(path,sizeof(path),"%s/%s/tests.txt",problems_dir,pr->id);
+    MappedFile mt;
+    if(map_file(path,&mt)) die("cannot open tests.txt");
+    check_labels(pr,&ref,(const char*)mt.data,mt.len);
+    unmap_file(&mt);
+    dfa_table_free(&ref);
+    double t2=now_ms();
+
+    pr->compile_ms=t1-t0;
+    pr->check_ms=t2-t1;
+    pr->total_ms=t2-t0;
+}
+
+static void run_child(Problem* pr, int timeout_s){
+    alarm((unsigned)timeout_s);
+    FILE* ferr=fmemopen(pr->error,sizeof(pr->error)-1,"w");
+    if(ferr){
+        setvbuf(ferr,NULL,_IONBF,0);
+        err_out=ferr;
+    }
+    jmp_buf jb;
+    die_jmp=&jb;
+    if(setjmp(jb)!=0) _exit(1);
+    build_one(pr);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF,&ru);
+    pr->peak_rss_kb=ru.ru_maxrss;
+    pr->done=1;
+    _exit(0);
+}
+
+/* ===== driver ===== */
+
+static void json_string(FILE* f, const char* s){
+    fputc('"',f);
+    for(; *s; s++){
+        unsigned char c=(unsigned char)*s;
+        if(c=='"' || c=='\\') fprintf(f,"\\%c",c);
+        else if(c=='\n') fputs("\\n",f);
+        else if(c<32) fprintf(f,"\\u%04x",c);
+        else fputc(c,f);
+    }
+    fputc('"',f);
+}
+
+int main(int argc, char** argv){
+    long ncpu=sysconf(_SC_NPROCESSORS_ONLN);
+    int jobs = ncpu>0 ? (int)ncpu : 1, timeout_s=60;
+    int argi=1;
+    compiler_options_default(&opt);
+    opt.binary=1;
+    for(; argi<argc && strncmp(argv[argi],"--",2)==0; argi++){
+        if(strcmp(argv[argi],"--jobs")==0 && argi+1<argc) jobs=atoi(argv[++argi]);
+        else if(strcmp(argv[argi],"--timeout")==0 && argi+1<argc) timeout_s=atoi(argv[++argi]);
+        else if(strcmp(argv[argi],"--text")==0) opt.binary=0;
+        else if(strcmp(argv[argi],"--glushkov")==0) opt.glushkov=1;
+        else break;
+    }
+    if(argc-argi!=2){
+        fprintf(stderr,"Usage: %s [--jobs N] [--timeout SEC] [--text] [--glushkov] <problems_dir> <out_dir>\n",argv[0]);
+        return 1;
+    }
+    if(jobs<1) jobs=1;
+    if(timeout_s<1) timeout_s=1;
+    problems_dir=argv[argi];
+    out_dir=argv[argi+1];
+    if(mkdir(out_dir,0777)!=0 && errno!=EEXIST) die("cannot create output directory");
+
+    find_problems(problems_dir);
+    double t0=now_ms();
+
+    pid_t* pid_of=(pid_t*)xmalloc((size_t)n_probs*sizeof(pid_t));
+    int* status=(int*)xmalloc((size_t)n_probs*sizeof(int));
+    memset(pid_of,0,(size_t)n_probs*sizeof(pid_t));
+    memset(status,0,(size_t)n_probs*sizeof(int));
+    int next=0, running=0;
+    fflush(stdout);
+    while(next<n_probs || running>0){
+        while(running<jobs && next<n_probs){
+            pid_t pid=fork();
+            if(pid<0) die("fork failed");
+            if(pid==0) run_child(&probs[next],timeout_s);
+            pid_of[next++]=pid;
+            running++;
+        }
+        int st=0;
+        pid_t pid=wait(&st);
+        if(pid<0) die("wait failed");
+        for(int i=0;i<next;i++) if(pid_of[i]==pid){ status[i]=st; break; }
+        running--;
+    }
+    double wall=now_ms()-t0;
+
+    int ok=0, errors=0, timeouts=0;
+    long mismatches=0;
+    for(int i=0;i<n_probs;i++){
+        Problem* pr=&probs[i];
+        const char* st="ok";
+        if(!pr->done){
+            st = (WIFSIGNALED(status[i]) && WTERMSIG(status[i])==SIGALRM) ? "timeout" : "error";
+            trim_newline(pr->error);
+            if(st[0]=='e' && pr->error[0]=='\0'){
+                if(WIFSIGNALED(status[i]))
+                    snprintf(pr->error,sizeof(pr->error),"Error: build killed by signal %d",WTERMSIG(status[i]));
+                else
+                    strcpy(pr->error,"Error: build failed");
+            }
+        }
+        for(int j=0;j<pr->mismatches && j<MAX_REPORTED;j++)
+            fprintf(stderr,"%s: WARNING: test label mismatch vs reference at line %d (label=%d, ref=%d)\n",
+                    pr->id,pr->mismatch_line[j],pr->mismatch_label[j],!pr->mismatch_label[j]);
+        if(pr->mismatches>MAX_REPORTED)
+            fprintf(stderr,"%s: ... %d more label mismatches\n",pr->id,pr->mismatches-MAX_REPORTED);
+
+        printf("{\"problem\":");
+        json_string(stdout,pr->id);
+        printf(",\"status\":\"%s\"",st);
+        if(pr->done){
+            printf(",\"states\":%d,\"tests\":%d,\"label_mismatches\":%d,\"compile_ms\":%.3f,\"check_ms\":%.3f,"
+                   "\"total_ms\":%.3f,\"peak_rss_kb\":%ld}\n",
+                   pr->states,pr->tests,pr->mismatches,pr->compile_ms,pr->check_ms,pr->total_ms,pr->peak_rss_kb);
+            ok++;
+            mismatches+=pr->mismatches;
+        } else {
+            if(st[0]=='e'){ printf(",\"error\":"); json_string(stdout,pr->error); }
+            printf("}\n");
+            if(st[0]=='t') timeouts++;
+            else errors++;
+        }
+    }
+    printf("{\"summary\":true,\"problems\":%d,\"ok\":%d,\"errors\":%d,\"timeouts\":%d,\"label_mismatches\":%ld,"
+           "\"wall_ms\":%.3f,\"jobs\":%d}\n",n_probs,ok,errors,timeouts,mismatches,wall,jobs);
+
+    free(pid_of);
+    free(status);
+    munmap(probs,(size_t)n_probs*sizeof(Problem));
+    if(errors || timeouts) return 1;
+    return mismatches ? 2 : 0;
+}
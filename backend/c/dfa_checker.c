@@ -5,7 +5,7 @@
     Compare two DFA files (produced by regex2mindfa_compiler.c) by running them on a test set.
 
   INPUTS
-    1) reference_dfa_file   (machine-parsable format)
+    1) reference_dfa_file   (machine-parsable format, text or binary, see automata.h)
     2) user_dfa_file        (same format)
     3) tests_file
 
@@ -17,6 +17,8 @@
       - string is a sequence of alphabet symbols
       - for the EMPTY STRING, write:  <label> <eps>
     Comments: lines starting with # are ignored.
+    Lines and strings may be any length, and a gzip-compressed tests file (also in
+    --serve requests) is read as is.
 
     Example:
       1 <eps>
@@ -24,6 +26,19 @@
       0 b
       1 abbb
 
+  EQUIVALENCE MODE (--equiv)
+    Decides L(ref) == L(user) exactly (Hopcroft-Karp, no tests file needed). On a
+    mismatch the reported w is a shortest string the two DFAs disagree on.
+
+  REPORT MODE (--report)
+    Checks every test instead of stopping at the first mismatch and prints one JSON
+    line on stdout:
+      {"tests":..,"passed":..,"failed":..,"failures":[{"line":..,"ref":0|1,"user":0|1},..],
+       "truncated":false|true,"shortest":{"line":..,"w":".."}|null}
+    failures lists the first 100 mismatching lines (truncated is true when there were
+    more), shortest is a shortest failing string ("" for <eps>, earliest line on
+    ties). Exit codes are as below; parse errors are reported as usual.
+
   OUTPUT
     Prints a verdict and first mismatch (if any).
     Exit code:
@@ -32,26 +47,93 @@
       1 => parse/usage error
 
   COMPILE
-    gcc -O2 -Wall -Wextra -std=c11 dfa_checker.c -o dfa_checker
+    gcc -O2 -Wall -Wextra -std=c11 dfa_checker.c automata.c -lz -o dfa_checker
+    (x86-64 builds pick an AVX2 kernel at run time; add -DDFA_NO_SIMD to leave it out)
 
   RUN
-    ./dfa_checker ref.dfa user.dfa tests.txt
+    ./dfa_checker [--stats] ref.dfa user.dfa tests.txt
+    ./dfa_checker [--stats] --report ref.dfa user.dfa tests.txt
+    ./dfa_checker [--stats] --equiv ref.dfa user.dfa
+    ./dfa_checker --binary in.dfa out.dfa     (rewrite a .dfa file in the binary format)
+    ./dfa_checker [--stats] --serve
+
+    Any input may be - (stdin) or /dev/fd/N, so a caller can pass files over pipes;
+    the --binary output may be - (stdout).
+
+    --stats ends stderr with one line once a check ran:
+      STATS {"tool":"dfa_checker","mode":"tests"|"report"|"equiv","load_ms":..,"check_ms":..,"total_ms":..,
+             "ref_states":..,"user_states":..,"ref_cached":0|1,"tests":..,"strings":..,"bytes":..,
+             "kernel":"avx2"|"scalar"|"none","equiv_pairs":..}
+    strings/bytes count what the batch engine simulated, tests the lines checked.
+
+    DFA and tests files are mapped, not read; a binary file's table is used without
+    text parsing, and test strings are taken from the mapping without copying lines.
+
+  SERVE PROTOCOL (long-running grader mode, one request at a time, fields are raw bytes)
+    request : "<opts_len> <key_len> <ref_len> <user_len> <tests_len>\n" followed by the
+              options, the reference key, the reference .dfa text, the user .dfa text and
+              the tests file contents
+    response: "<exit_code> <stdout_len> <stderr_len>\n" followed by the stdout and
+              stderr bytes the command line tool would have printed
+
+    options is a space separated list of command line flags: --equiv (the tests field
+    is then ignored), --report and --stats.
+
+    Editor sessions: with "--session <id>" the user field is an edit script for the DFA
+    that session keeps in the worker instead of a .dfa (see session_edit), then the
+    check runs as usual; "--session <id> --close" forgets it. A script for an unknown
+    session must start with "reset", else the response is "Error: session not found"
+    and the caller resends its whole log. Up to 64 sessions are kept per worker (in the
+    Node addon, 64 in all, shared by its threads).
+
+    A non-empty key names the reference (the server uses "<problemId>:<hash of ref.txt>").
+    Parsed references are kept per key, so a repeated key skips parsing the
+    reference text. An empty key always parses it.
 */
 
+#define _POSIX_C_SOURCE 200809L /* strtok_r, clock_gettime */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <time.h>
+#ifdef GRADER_LIBRARY
+#include <pthread.h>
+#endif
 
-#define MAX_LINE 8192
-#define MAX_ALPHABET 128
+#include "automata.h"
+
+
+/* In --serve mode die() reports into the request's stderr and unwinds to the serve loop. */
+static TOOL_LOCAL FILE* err_out=NULL;
+static TOOL_LOCAL jmp_buf* die_jmp=NULL;
+static FILE* errs(void){ return err_out ? err_out : stderr; }
 
 static void die(const char* msg){
-    fprintf(stderr,"Error: %s\n",msg);
+    fprintf(errs(),"Error: %s\n",msg);
+#ifdef GRADER_LIBRARY
+    longjmp(*die_jmp,1); /* dfa_checker_call always sets it */
+#else
+    if(die_jmp) longjmp(*die_jmp,1);
     exit(1);
+#endif
 }
 static void* xmalloc(size_t n){ void* p=malloc(n); if(!p) die("out of memory"); return p; }
-static void* xcalloc(size_t n,size_t s){ void* p=calloc(n,s); if(!p) die("out of memory"); return p; }
+
+static double now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec*1e3 + (double)ts.tv_nsec/1e6;
+}
+
+/* --stats counters for the last check */
+static TOOL_LOCAL int show_stats=0;
+static TOOL_LOCAL double load_ms=0, check_ms=0;
+static TOOL_LOCAL long sim_strings=0, sim_bytes=0;
+static TOOL_LOCAL int tests_run=0, equiv_pairs=0, ref_cached=0;
+static TOOL_LOCAL const char* sim_kernel="none";
 
 typedef struct {
     int k;              /* alphabet size */
@@ -59,7 +141,13 @@ typedef struct {
     int n;              /* states */
     int start;
     unsigned char* acc; /* length n: 0/1 */
-    int* trans;         /* n*k */
+    int* trans;         /* n*k; NULL for a binary file, which is read into ct directly */
+    signed char col[256]; /* byte -> alphabet column, -1 if not in alphabet */
+    unsigned char* ct;  /* class-compressed table (dfa_compact), NULL until first use */
+    int ct_width;       /* bytes per state id in ct: 1, 2 or 4 */
+    int ct_shift;       /* ct rows have 1<<ct_shift columns */
+    int ct_classes;     /* symbol classes, one ct column each */
+    unsigned char ct_class[DFA_MAX_ALPHABET]; /* alphabet column -> class */
 } DFA;
 
 static void dfa_free(DFA* d){
@@ -67,196 +155,1002 @@ static void dfa_free(DFA* d){
     free(d->alphabet);
     free(d->acc);
     free(d->trans);
+    free(d->ct);
     memset(d,0,sizeof(*d));
 }
 
-static int alph_index(const DFA* d, char c){
-    for(int i=0;i<d->k;i++) if(d->alphabet[i]==c) return i;
-    return -1;
+static void dfa_finish(DFA* d);
+static void dfa_compact_from(DFA* d, const DfabView* v);
+
+/* A .dfa file held in memory, in either format. A binary table goes straight into
+   the compact table, without an n*k int copy; p need not outlive d. */
+static void dfa_load_mem(const char* p, size_t len, DFA* d){
+    DfaTable t;
+    DfabView v;
+    memset(d,0,sizeof(*d));
+    const char* err=dfa_table_load_view(p,len,&t,&v);
+    if(err) die(err);
+    d->k=t.k;
+    d->alphabet=t.alphabet;
+    d->n=t.n;
+    d->start=t.start;
+    d->acc=t.acc;
+    d->trans=t.trans;
+    dfa_finish(d);
+    if(v.trans) dfa_compact_from(d,&v);
 }
 
-static int run_dfa(const DFA* d, const char* s){
-    int st = d->start;
-    for(size_t i=0; s[i]; i++){
-        char c = s[i];
-        int idx = alph_index(d, c);
-        if(idx < 0) return -1; /* invalid char */
-        st = d->trans[st*d->k + idx];
-    }
-    return d->acc[st] ? 1 : 0;
-}
-
-static void expect_token(FILE* f, const char* tok){
-    char buf[64];
-    if(fscanf(f,"%63s",buf)!=1) die("unexpected EOF while reading DFA");
-    if(strcmp(buf,tok)!=0) die("bad DFA format: unexpected header token");
-}
-
-static DFA dfa_read(const char* path){
-    DFA d; memset(&d,0,sizeof(d));
-    FILE* f = fopen(path,"r");
-    if(!f) die("cannot open DFA file");
-
-    expect_token(f,"ALPHABET");
-    if(fscanf(f,"%d",&d.k)!=1) die("bad DFA format: alphabet size");
-    if(d.k<=0 || d.k>MAX_ALPHABET) die("bad DFA format: alphabet size range");
-    d.alphabet = (char*)xmalloc((size_t)d.k + 1);
-
-    // read the alphabet string (no spaces)
-    char alphbuf[1024];
-    if(fscanf(f,"%1023s",alphbuf)!=1) die("bad DFA format: alphabet string");
-    if((int)strlen(alphbuf) != d.k) die("bad DFA format: alphabet string length mismatch");
-    memcpy(d.alphabet, alphbuf, (size_t)d.k);
-    d.alphabet[d.k]='\0';
-
-    expect_token(f,"STATES");
-    if(fscanf(f,"%d",&d.n)!=1) die("bad DFA format: states");
-    if(d.n<=0) die("bad DFA format: states must be positive");
-
-    expect_token(f,"START");
-    if(fscanf(f,"%d",&d.start)!=1) die("bad DFA format: start");
-    if(d.start<0 || d.start>=d.n) die("bad DFA format: start out of range");
-
-    expect_token(f,"ACCEPT");
-    int m=0;
-    if(fscanf(f,"%d",&m)!=1) die("bad DFA format: accept count");
-    if(m<0 || m>d.n) die("bad DFA format: accept count range");
-    d.acc = (unsigned char*)xcalloc((size_t)d.n, 1);
-    for(int i=0;i<m;i++){
-        int a=0;
-        if(fscanf(f,"%d",&a)!=1) die("bad DFA format: accept list");
-        if(a<0 || a>=d.n) die("bad DFA format: accepting state out of range");
-        d.acc[a]=1;
+#ifndef GRADER_LIBRARY
+static void dfa_map(const char* path, MappedFile* m){
+    if(map_file(path,m)) die("cannot open DFA file");
+}
+#endif
+
+/* Alphabet checks shared by both formats. */
+static void dfa_finish(DFA* d){
+    // extra check: alphabet unique; builds the byte -> column table on the way
+    memset(d->col,-1,sizeof(d->col));
+    for(int i=0;i<d->k;i++){
+        unsigned char uc=(unsigned char)d->alphabet[i];
+        if(d->col[uc]>=0) die("bad DFA: duplicate symbol in alphabet");
+        d->col[uc]=(signed char)i;
     }
+}
+
+static int same_alphabet(const DFA* a, const DFA* b){
+    if(a->k != b->k) return 0;
+    return memcmp(a->alphabet, b->alphabet, (size_t)a->k) == 0;
+}
+
+/* ===== batch engine ===== */
+
+/*
+  Test strings are simulated BATCH_LANES at a time, with ref and usr advanced in
+  lockstep, so the dependent load chain of one string overlaps with the others.
 
-    expect_token(f,"TRANS");
-    d.trans = (int*)xmalloc((size_t)d.n*(size_t)d.k*sizeof(int));
-    for(int s=0;s<d.n;s++){
-        for(int a=0;a<d.k;a++){
-            int t=0;
-            if(fscanf(f,"%d",&t)!=1) die("bad DFA format: transition table");
-            if(t<0 || t>=d.n) die("bad DFA format: transition out of range");
-            d.trans[s*d.k + a] = t;
+  Compact table: symbols whose columns are equal in every state share one column
+  (dfa_symbol_classes), so a DFA with c symbol classes has rows of 1<<shift columns,
+  shift being the smallest with 1<<shift > c; row n is an extra INV state, and
+  column c plus the padding columns lead to INV. The byte -> column table holds the
+  reference's column in its low 16 bits and the user's in the high 16; bytes outside
+  the alphabet map to column c of each, so a string with a bad symbol simply ends in
+  INV and the inner loop needs no branch. State ids are stored in 1, 2 or 4 bytes,
+  whichever fits n + 1, so a reference with up to 255 states and a few classes is a
+  table of a few hundred bytes. The allocation has 3 spare bytes because the AVX2
+  kernel reads every cell with a 32-bit gather and masks it down.
+
+  Rounds: every active lane takes m steps, m being the fewest bytes any active lane
+  has left; lanes that finish then retire and pick up the next string. Idle lanes
+  sit on offset 0 of the string buffer with a zero increment.
+
+  Build with -DDFA_NO_SIMD to force the portable kernel. NEON has no gather, so on
+  ARM the interleaved scalar kernel is what runs.
+*/
+#define BATCH_LANES 8
+#define BATCH_TESTS 8192
+#define BATCH_BYTES (1u<<22)
+#define BATCH_PAD 4     /* readable bytes after the string buffer for 32-bit gathers */
+
+static int stride_shift(int k){
+    int sh=0;
+    while((1<<sh) <= k) sh++;
+    return sh;
+}
+
+/* Builds ct from d->trans, or from v, a binary file's table of 1, 2 or 4 byte ids. */
+static void dfa_compact_from(DFA* d, const DfabView* v){
+    const int nc = v ? dfab_symbol_classes(v,d->ct_class) : dfa_symbol_classes(d->n,d->k,d->trans,d->ct_class);
+    int first[DFA_MAX_ALPHABET];    /* class -> a column of it */
+    for(int a=d->k-1;a>=0;a--) first[d->ct_class[a]]=a;
+    const int sh=stride_shift(nc);
+    const size_t rows=(size_t)d->n+1, cols=(size_t)1<<sh;
+    const int w = rows<=256 ? 1 : rows<=65536 ? 2 : 4;
+    d->ct=(unsigned char*)xmalloc(rows*cols*(size_t)w+3);
+    d->ct_width=w;
+    d->ct_shift=sh;
+    d->ct_classes=nc;
+    uint32_t buf[DFA_MAX_ALPHABET], row[256];
+    for(size_t s=0;s<rows;s++){
+        for(size_t c=0;c<cols;c++) row[c]=(uint32_t)d->n;
+        if(s<(size_t)d->n){
+            if(v){
+                dfab_row(v,(int)s,buf);
+                for(int c=0;c<nc;c++) row[c]=buf[first[c]];
+            } else {
+                const int* tr=&d->trans[s*(size_t)d->k];
+                for(int c=0;c<nc;c++) row[c]=(uint32_t)tr[first[c]];
+            }
         }
+        unsigned char* out=d->ct+s*cols*(size_t)w;
+        if(w==1) for(size_t c=0;c<cols;c++) out[c]=(uint8_t)row[c];
+        else if(w==2) for(size_t c=0;c<cols;c++) ((uint16_t*)out)[c]=(uint16_t)row[c];
+        else memcpy(out,row,cols*sizeof(uint32_t));
     }
+}
+
+static void dfa_compact(DFA* d){
+    if(!d->ct) dfa_compact_from(d,NULL);
+}
 
-    expect_token(f,"END");
-    fclose(f);
+/* Successor of state s on alphabet column a, read from ct. */
+static uint32_t dfa_next(const DFA* d, uint32_t s, int a){
+    size_t i=((size_t)s<<d->ct_shift)+d->ct_class[a];
+    if(d->ct_width==1) return d->ct[i];
+    if(d->ct_width==2) return ((const uint16_t*)d->ct)[i];
+    return ((const uint32_t*)d->ct)[i];
+}
 
-    // extra check: alphabet unique
-    int seen[256]={0};
-    for(int i=0;i<d.k;i++){
-        unsigned char uc=(unsigned char)d.alphabet[i];
-        if(seen[uc]) die("bad DFA: duplicate symbol in alphabet");
-        seen[uc]=1;
+#ifndef GRADER_LIBRARY
+/* d->trans, widened from ct for a DFA loaded from a binary file (--binary). */
+static const int* dfa_trans(DFA* d){
+    if(!d->trans){
+        d->trans=(int*)xmalloc((size_t)d->n*(size_t)d->k*sizeof(int));
+        for(int s=0;s<d->n;s++)
+            for(int a=0;a<d->k;a++) d->trans[(size_t)s*d->k+a]=(int)dfa_next(d,(uint32_t)s,a);
     }
+    return d->trans;
+}
+#endif
+
+typedef struct {
+    const unsigned char* buf;   /* test strings */
+    const int32_t* col;         /* byte -> ref column | usr column << 16 */
+    const void* rt; int rw, rsh; /* ref compact table, its width and row shift */
+    const void* ut; int uw, ush; /* usr compact table, its width and row shift */
+} BatchCtx;
 
-    return d;
+typedef void (*BatchKernel)(const BatchCtx* bc, int m, int32_t* pos, const int32_t* inc, uint32_t* r, uint32_t* u);
+
+#define SCALAR_KERNEL(NAME, TR, TU) \
+static void NAME(const BatchCtx* bc, int m, int32_t* pos, const int32_t* inc, uint32_t* r, uint32_t* u){ \
+    const TR* R=(const TR*)bc->rt; \
+    const TU* U=(const TU*)bc->ut; \
+    const unsigned char* buf=bc->buf; \
+    const int32_t* col=bc->col; \
+    const int rsh=bc->rsh, ush=bc->ush; \
+    for(int t=0;t<m;t++){ \
+        for(int l=0;l<BATCH_LANES;l++){ \
+            uint32_t c=(uint32_t)col[buf[pos[l]]]; \
+            r[l]=R[((size_t)r[l]<<rsh)|(c&0xffff)]; \
+            u[l]=U[((size_t)u[l]<<ush)|(c>>16)]; \
+            pos[l]+=inc[l]; \
+        } \
+    } \
 }
+SCALAR_KERNEL(kernel_1_1, uint8_t,  uint8_t)
+SCALAR_KERNEL(kernel_1_2, uint8_t,  uint16_t)
+SCALAR_KERNEL(kernel_1_4, uint8_t,  uint32_t)
+SCALAR_KERNEL(kernel_2_1, uint16_t, uint8_t)
+SCALAR_KERNEL(kernel_2_2, uint16_t, uint16_t)
+SCALAR_KERNEL(kernel_2_4, uint16_t, uint32_t)
+SCALAR_KERNEL(kernel_4_1, uint32_t, uint8_t)
+SCALAR_KERNEL(kernel_4_2, uint32_t, uint16_t)
+SCALAR_KERNEL(kernel_4_4, uint32_t, uint32_t)
 
-static int same_alphabet(const DFA* a, const DFA* b){
-    if(a->k != b->k) return 0;
-    return memcmp(a->alphabet, b->alphabet, (size_t)a->k) == 0;
+static BatchKernel scalar_kernel(int rw, int uw){
+    static const BatchKernel k[3][3]={
+        { kernel_1_1, kernel_1_2, kernel_1_4 },
+        { kernel_2_1, kernel_2_2, kernel_2_4 },
+        { kernel_4_1, kernel_4_2, kernel_4_4 },
+    };
+    return k[rw>>1][uw>>1];
 }
 
-static void trim_newline(char* s){
-    size_t n=strlen(s);
-    while(n>0 && (s[n-1]=='\n' || s[n-1]=='\r')) s[--n]='\0';
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(DFA_NO_SIMD)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+
+static int width_shift(int w){ return w==1 ? 0 : w==2 ? 1 : 2; }
+static int width_mask(int w){ return w==1 ? 0xff : w==2 ? 0xffff : -1; }
+
+__attribute__((target("avx2")))
+static void kernel_avx2(const BatchCtx* bc, int m, int32_t* pos, const int32_t* inc, uint32_t* r, uint32_t* u){
+    const __m256i ff=_mm256_set1_epi32(0xff);
+    const __m256i lo16=_mm256_set1_epi32(0xffff);
+    const __m128i rsh=_mm_cvtsi32_si128(bc->rsh);
+    const __m128i ush=_mm_cvtsi32_si128(bc->ush);
+    const __m128i rws=_mm_cvtsi32_si128(width_shift(bc->rw));
+    const __m128i uws=_mm_cvtsi32_si128(width_shift(bc->uw));
+    const __m256i rmask=_mm256_set1_epi32(width_mask(bc->rw));
+    const __m256i umask=_mm256_set1_epi32(width_mask(bc->uw));
+    const int* buf=(const int*)bc->buf;
+    const int* col=(const int*)bc->col;
+    const int* rt=(const int*)bc->rt;
+    const int* ut=(const int*)bc->ut;
+
+    __m256i P=_mm256_loadu_si256((const __m256i*)pos);
+    __m256i I=_mm256_loadu_si256((const __m256i*)inc);
+    __m256i R=_mm256_loadu_si256((const __m256i*)r);
+    __m256i U=_mm256_loadu_si256((const __m256i*)u);
+    for(int t=0;t<m;t++){
+        __m256i b=_mm256_and_si256(_mm256_i32gather_epi32(buf,P,1),ff);
+        __m256i c=_mm256_i32gather_epi32(col,b,4);
+        __m256i ir=_mm256_sll_epi32(_mm256_or_si256(_mm256_sll_epi32(R,rsh),_mm256_and_si256(c,lo16)),rws);
+        __m256i iu=_mm256_sll_epi32(_mm256_or_si256(_mm256_sll_epi32(U,ush),_mm256_srli_epi32(c,16)),uws);
+        R=_mm256_and_si256(_mm256_i32gather_epi32(rt,ir,1),rmask);
+        U=_mm256_and_si256(_mm256_i32gather_epi32(ut,iu,1),umask);
+        P=_mm256_add_epi32(P,I);
+    }
+    _mm256_storeu_si256((__m256i*)pos,P);
+    _mm256_storeu_si256((__m256i*)r,R);
+    _mm256_storeu_si256((__m256i*)u,U);
 }
 
-int main(int argc, char** argv){
-    if(argc != 4){
-        fprintf(stderr,"Usage: %s <ref.dfa> <user.dfa> <tests.txt>\n", argv[0]);
-        return 1;
+static int have_avx2(void){
+    static TOOL_LOCAL int v=-1;
+    if(v<0){
+        __builtin_cpu_init();
+        v=__builtin_cpu_supports("avx2") ? 1 : 0;
     }
+    return v;
+}
+#endif
 
-    DFA ref = dfa_read(argv[1]);
-    DFA usr = dfa_read(argv[2]);
+/* One parsed test line; the string lives in tb_buf[off .. off+len). */
+typedef struct { int line_no, label; int32_t off, len; } TestRec;
 
-    if(!same_alphabet(&ref,&usr)){
-        fprintf(stderr,"FAIL: alphabets differ between reference and user DFA.\n");
-        fprintf(stderr,"ref: %s\nuser:%s\n", ref.alphabet, usr.alphabet);
-        dfa_free(&ref); dfa_free(&usr);
-        return 2;
+static TOOL_LOCAL TestRec* tb_rec=NULL;
+static TOOL_LOCAL int tb_n=0, tb_cap=0;
+static TOOL_LOCAL unsigned char* tb_buf=NULL;
+static TOOL_LOCAL size_t tb_len=0, tb_bcap=0;
+static TOOL_LOCAL signed char* tb_rref=NULL; /* per test: 1/0 accept, -1 bad symbol */
+static TOOL_LOCAL signed char* tb_rusr=NULL;
+
+static void batch_free(void){
+    free(tb_rec); free(tb_buf); free(tb_rref); free(tb_rusr);
+    tb_rec=NULL; tb_buf=NULL; tb_rref=NULL; tb_rusr=NULL;
+    tb_n=tb_cap=0; tb_len=tb_bcap=0;
+}
+
+static void batch_add(int line_no, int label, const char* w, size_t len){
+    if(len > (size_t)INT32_MAX-BATCH_PAD-tb_len) die("tests string too long");
+    if(tb_n==tb_cap){
+        tb_cap = tb_cap ? tb_cap*2 : 256;
+        TestRec* nr=(TestRec*)realloc(tb_rec,(size_t)tb_cap*sizeof(TestRec));
+        if(!nr) die("out of memory");
+        tb_rec=nr;
+    }
+    if(tb_len+len+BATCH_PAD > tb_bcap){
+        size_t cap = tb_bcap ? tb_bcap : 4096;
+        while(cap < tb_len+len+BATCH_PAD) cap*=2;
+        unsigned char* nb=(unsigned char*)realloc(tb_buf,cap);
+        if(!nb) die("out of memory");
+        tb_buf=nb;
+        tb_bcap=cap;
     }
+    memcpy(tb_buf+tb_len,w,len);
+    tb_rec[tb_n++]=(TestRec){ line_no, label, (int32_t)tb_len, (int32_t)len };
+    tb_len+=len;
+}
 
-    FILE* ft = fopen(argv[3],"r");
-    if(!ft) die("cannot open tests file");
-
-    char line[MAX_LINE];
-    int line_no=0;
-    int total=0;
-    while(fgets(line,sizeof(line),ft)){
-        line_no++;
-        trim_newline(line);
-
-        // skip empty/comment
-        char* p=line;
-        while(*p && isspace((unsigned char)*p)) p++;
-        if(*p=='\0' || *p=='#') continue;
-
-        int label=-1;
-        // label is first token
-        if(*p!='0' && *p!='1'){
-            fprintf(stderr,"Error: tests line %d: label must be 0 or 1\n", line_no);
-            fclose(ft); dfa_free(&ref); dfa_free(&usr);
-            return 1;
-        }
-        label = (*p=='1') ? 1 : 0;
-        p++;
-        // skip whitespace
-        while(*p && isspace((unsigned char)*p)) p++;
-
-        // read string token
-        char strbuf[MAX_LINE];
-        if(*p=='\0'){
-            fprintf(stderr,"Error: tests line %d: missing string token (use <eps> for empty)\n", line_no);
-            fclose(ft); dfa_free(&ref); dfa_free(&usr);
-            return 1;
-        }
+static signed char final_verdict(const DFA* d, uint32_t st){
+    return st==(uint32_t)d->n ? -1 : (signed char)d->acc[st];
+}
 
-        // take the rest as a single token (no spaces inside strings)
-        // stop at whitespace
-        int j=0;
-        while(*p && !isspace((unsigned char)*p) && j < (int)sizeof(strbuf)-1){
-            strbuf[j++] = *p++;
+/* Fills tb_rref/tb_rusr for the tb_n queued tests. */
+static void batch_run(DFA* ref, DFA* usr){
+    dfa_compact(ref);
+    dfa_compact(usr);
+    free(tb_rref); free(tb_rusr);
+    tb_rref=NULL; tb_rusr=NULL; /* batch_free() runs after a die() */
+    tb_rref=(signed char*)xmalloc((size_t)tb_n+1);
+    tb_rusr=(signed char*)xmalloc((size_t)tb_n+1);
+    if(tb_bcap < tb_len+BATCH_PAD){
+        unsigned char* nb=(unsigned char*)realloc(tb_buf,tb_len+BATCH_PAD);
+        if(!nb) die("out of memory");
+        tb_buf=nb;
+        tb_bcap=tb_len+BATCH_PAD;
+    }
+    memset(tb_buf+tb_len,0,BATCH_PAD);
+
+    int32_t col[256];
+    for(int b=0;b<256;b++){
+        int rc = ref->col[b]>=0 ? ref->ct_class[ref->col[b]] : ref->ct_classes;
+        int uc = usr->col[b]>=0 ? usr->ct_class[usr->col[b]] : usr->ct_classes;
+        col[b]=(int32_t)((uint32_t)rc | (uint32_t)uc<<16);
+    }
+
+    BatchCtx bc={ tb_buf, col, ref->ct, ref->ct_width, ref->ct_shift, usr->ct, usr->ct_width, usr->ct_shift };
+    BatchKernel kernel=scalar_kernel(ref->ct_width, usr->ct_width);
+    sim_kernel="scalar";
+#ifdef HAVE_AVX2_KERNEL
+    /* gathers take 32-bit byte offsets */
+    size_t rbytes=((size_t)ref->n+1)*((size_t)1<<bc.rsh)*(size_t)ref->ct_width;
+    size_t ubytes=((size_t)usr->n+1)*((size_t)1<<bc.ush)*(size_t)usr->ct_width;
+    if(have_avx2() && rbytes<=INT32_MAX && ubytes<=INT32_MAX){ kernel=kernel_avx2; sim_kernel="avx2"; }
+#endif
+
+    int32_t pos[BATCH_LANES], end[BATCH_LANES], inc[BATCH_LANES];
+    uint32_t r[BATCH_LANES], u[BATCH_LANES];
+    int test[BATCH_LANES];
+    for(int l=0;l<BATCH_LANES;l++){ pos[l]=0; end[l]=0; inc[l]=0; r[l]=0; u[l]=0; test[l]=-1; }
+
+    sim_strings+=tb_n;
+    sim_bytes+=(long)tb_len;
+
+    int next=0, active=0;
+    for(;;){
+        for(int l=0;l<BATCH_LANES;l++){
+            if(test[l]>=0 && pos[l]==end[l]){
+                tb_rref[test[l]]=final_verdict(ref,r[l]);
+                tb_rusr[test[l]]=final_verdict(usr,u[l]);
+                test[l]=-1; pos[l]=0; inc[l]=0; r[l]=0; u[l]=0;
+                active--;
+            }
+            while(test[l]<0 && next<tb_n){
+                const TestRec* t=&tb_rec[next];
+                if(t->len==0){
+                    tb_rref[next]=(signed char)ref->acc[ref->start];
+                    tb_rusr[next]=(signed char)usr->acc[usr->start];
+                    next++;
+                    continue;
+                }
+                test[l]=next++;
+                pos[l]=t->off; end[l]=t->off+t->len; inc[l]=1;
+                r[l]=(uint32_t)ref->start; u[l]=(uint32_t)usr->start;
+                active++;
+            }
         }
-        strbuf[j]='\0';
+        if(active==0) break;
 
-        const char* w = strbuf;
-        char empty[1]={0};
-        if(strcmp(w,"<eps>")==0) w = empty;
+        int m=INT32_MAX;
+        for(int l=0;l<BATCH_LANES;l++) if(test[l]>=0 && end[l]-pos[l]<m) m=end[l]-pos[l];
+        kernel(&bc,m,pos,inc,r,u);
+    }
+}
+
+/*
+  --report: every test is checked and the mismatches are collected instead of
+  stopping at the first one. The first REPORT_MAX_FAILURES are listed, and the
+  shortest failing string (earliest line on ties) is copied out of the batch.
+*/
+#define REPORT_MAX_FAILURES 100
+typedef struct { int line_no; signed char ref, usr; } Failure;
+typedef struct {
+    int on;
+    int failed;
+    Failure fail[REPORT_MAX_FAILURES];
+    int short_line;     /* 0 until a failure was seen */
+    char* short_w;
+    size_t short_len;
+} Report;
+static TOOL_LOCAL Report report;
 
-        int rref = run_dfa(&ref, w);
-        int rusr = run_dfa(&usr, w);
+static void report_reset(int on){
+    free(report.short_w);
+    memset(&report,0,sizeof(report));
+    report.on=on;
+}
+
+static void report_failure(const TestRec* t, int rref, int rusr){
+    if(report.failed < REPORT_MAX_FAILURES) report.fail[report.failed]=(Failure){ t->line_no, (signed char)rref, (signed char)rusr };
+    report.failed++;
+    if(report.short_line && (size_t)t->len >= report.short_len) return;
+    char* w=(char*)xmalloc((size_t)t->len+1);
+    memcpy(w,tb_buf+t->off,(size_t)t->len);
+    free(report.short_w);
+    report.short_w=w;
+    report.short_len=(size_t)t->len;
+    report.short_line=t->line_no;
+}
+
+static void json_string(FILE* f, const char* s, size_t n){
+    fputc('"',f);
+    for(size_t i=0;i<n;i++){
+        unsigned char c=(unsigned char)s[i];
+        if(c=='"' || c=='\\') fprintf(f,"\\%c",c);
+        else if(c<0x20 || c==0x7f) fprintf(f,"\\u%04x",c);
+        else fputc(c,f);
+    }
+    fputc('"',f);
+}
+
+/* One JSON line on out; the empty string is reported as "". */
+static void print_report(FILE* out){
+    fprintf(out,"{\"tests\":%d,\"passed\":%d,\"failed\":%d,\"failures\":[",
+            tests_run,tests_run-report.failed,report.failed);
+    int shown = report.failed < REPORT_MAX_FAILURES ? report.failed : REPORT_MAX_FAILURES;
+    for(int i=0;i<shown;i++){
+        fprintf(out,"%s{\"line\":%d,\"ref\":%d,\"user\":%d}", i ? "," : "",
+                report.fail[i].line_no,report.fail[i].ref,report.fail[i].usr);
+    }
+    fprintf(out,"],\"truncated\":%s,\"shortest\":", report.failed > shown ? "true" : "false");
+    if(report.short_line){
+        fprintf(out,"{\"line\":%d,\"w\":",report.short_line);
+        json_string(out,report.short_w,report.short_len);
+        fputc('}',out);
+    } else {
+        fputs("null",out);
+    }
+    fputs("}\n",out);
+}
+
+/* Reports the queued tests in line order; returns an exit code, or -1 to keep going. */
+static int batch_report(DFA* ref, DFA* usr){
+    if(tb_n==0) return -1;
+    batch_run(ref,usr);
+    for(int i=0;i<tb_n;i++){
+        const TestRec* t=&tb_rec[i];
+        int rref=tb_rref[i], rusr=tb_rusr[i];
         if(rref < 0 || rusr < 0){
-            fprintf(stderr,"Error: tests line %d: string contains symbol not in alphabet\n", line_no);
-            fclose(ft); dfa_free(&ref); dfa_free(&usr);
+            fprintf(errs(),"Error: tests line %d: string contains symbol not in alphabet\n", t->line_no);
             return 1;
         }
 
-        total++;
+        tests_run++;
 
         // core check: user matches reference
-        if(rref != rusr){
-            fprintf(stderr,"FAIL at test line %d\n", line_no);
-            fprintf(stderr,"  w = %s\n", (w[0]=='\0') ? "<eps>" : w);
-            fprintf(stderr,"  ref_accept = %d, user_accept = %d\n", rref, rusr);
-            fprintf(stderr,"  label = %d\n", label);
-            fclose(ft); dfa_free(&ref); dfa_free(&usr);
+        if(rref != rusr && report.on){
+            report_failure(t,rref,rusr);
+        } else if(rref != rusr){
+            fprintf(errs(),"FAIL at test line %d\n", t->line_no);
+            if(t->len==0) fprintf(errs(),"  w = <eps>\n");
+            else fprintf(errs(),"  w = %.*s\n", (int)t->len, (const char*)tb_buf+t->off);
+            fprintf(errs(),"  ref_accept = %d, user_accept = %d\n", rref, rusr);
+            fprintf(errs(),"  label = %d\n", t->label);
             return 2;
         }
 
         // optional: sanity check that tests label matches reference
-        if(rref != label){
-            fprintf(stderr,"WARNING: test label mismatch vs reference at line %d (label=%d, ref=%d)\n",
-                    line_no, label, rref);
+        if(rref != t->label){
+            fprintf(errs(),"WARNING: test label mismatch vs reference at line %d (label=%d, ref=%d)\n",
+                    t->line_no, t->label, rref);
+        }
+    }
+    tb_n=0;
+    tb_len=0;
+    return -1;
+}
+
+/* Both DFAs and the tests reader live at file scope so --serve can release them after a die(). */
+static TOOL_LOCAL DFA ref_dfa, usr_dfa;
+static TOOL_LOCAL TestReader reader;
+
+/*
+  Runs the tests (the tests file contents, plain or gzip); returns the tool's exit
+  code. Lines are parsed into batches of up to BATCH_TESTS strings and each batch is reported in order, so the output is the
+  same as checking one line at a time: a parse error is only printed after the
+  verdicts of every line before it.
+*/
+static int check_dfas(DFA* ref, DFA* usr, const char* tests, size_t tests_len, FILE* out){
+    if(!same_alphabet(ref,usr)){
+        fprintf(errs(),"FAIL: alphabets differ between reference and user DFA.\n");
+        fprintf(errs(),"ref: %s\nuser:%s\n", ref->alphabet, usr->alphabet);
+        return 2;
+    }
+
+    const char* err=test_reader_open(&reader,tests,tests_len);
+    if(err) die(err);
+    int code;
+    tb_n=0;
+    tb_len=0;
+    for(;;){
+        int label=0;
+        const char* w=NULL;
+        size_t wlen=0;
+        int r=test_reader_next(&reader,&label,&w,&wlen,&err);
+        if(r==0) break;
+        if(r<0){
+            if((code=batch_report(ref,usr))>=0) return code;
+            if(r==-2) fprintf(errs(),"Error: %s\n", err);
+            else fprintf(errs(),"Error: tests line %d: %s\n", reader.line_no, err);
+            return 1;
+        }
+
+        batch_add(reader.line_no, label, w, wlen);
+        if(steps_spend(1+(long)(wlen>>5))) die("step budget exceeded");
+        if(tb_n>=BATCH_TESTS || tb_len>=BATCH_BYTES){
+            if((code=batch_report(ref,usr))>=0) return code;
         }
     }
+    if((code=batch_report(ref,usr))>=0) return code;
 
-    fclose(ft);
-    printf("PASS: %d tests matched (user DFA behavior == reference DFA behavior).\n", total);
+    if(report.on){
+        print_report(out);
+        return report.failed ? 2 : 0;
+    }
+    fprintf(out,"PASS: %d tests matched (user DFA behavior == reference DFA behavior).\n", tests_run);
+    return 0;
+}
+
+/* ===== --equiv: exact language equivalence ===== */
+
+/*
+  Hopcroft-Karp: union-find over the disjoint union of both state sets (user state q
+  is element ref->n + q), with state pairs explored breadth first. A pair is queued
+  only when it merges two classes, so at most ref->n + usr->n - 1 pairs are queued
+  and the check is O((n1+n2)*k*alpha) however large the tests file is.
+
+  Every queued pair is reached by a string that leads ref and usr to its two states,
+  so a pair with different acceptance is a counterexample. In BFS order the first
+  one found is also a shortest one: had a shorter distinguishing string w existed,
+  the pair it reaches is joined by a chain of pairs queued no later than |w|, and
+  one link of that chain would already disagree on acceptance.
+*/
+typedef struct { int p, q, from, sym; } PairNode;
+static TOOL_LOCAL int* uf_parent=NULL;
+static TOOL_LOCAL int* uf_size=NULL;
+static TOOL_LOCAL PairNode* pairs=NULL;
+static TOOL_LOCAL char* cex=NULL;
+
+static void equiv_free(void){
+    free(uf_parent); free(uf_size); free(pairs); free(cex);
+    uf_parent=NULL; uf_size=NULL; pairs=NULL; cex=NULL;
+}
+
+static int uf_find(int x){
+    while(uf_parent[x]!=x){
+        uf_parent[x]=uf_parent[uf_parent[x]];
+        x=uf_parent[x];
+    }
+    return x;
+}
+
+/* Joins the classes of a and b; returns 0 if they were already one class. */
+static int uf_union(int a, int b){
+    a=uf_find(a); b=uf_find(b);
+    if(a==b) return 0;
+    if(uf_size[a]<uf_size[b]){ int t=a; a=b; b=t; }
+    uf_parent[b]=a;
+    uf_size[a]+=uf_size[b];
+    return 1;
+}
+
+/* Decides L(ref) == L(usr); returns the tool's exit code. */
+static int check_equiv(DFA* ref, DFA* usr, FILE* out){
+    if(!same_alphabet(ref,usr)){
+        fprintf(errs(),"FAIL: alphabets differ between reference and user DFA.\n");
+        fprintf(errs(),"ref: %s\nuser:%s\n", ref->alphabet, usr->alphabet);
+        return 2;
+    }
+    dfa_compact(ref);
+    dfa_compact(usr);
+
+    const int k=ref->k;
+    const int n=ref->n+usr->n;
+    uf_parent=(int*)xmalloc((size_t)n*sizeof(int));
+    uf_size=(int*)xmalloc((size_t)n*sizeof(int));
+    pairs=(PairNode*)xmalloc((size_t)n*sizeof(PairNode));
+    for(int i=0;i<n;i++){ uf_parent[i]=i; uf_size[i]=1; }
+
+    int head=0, tail=0, bad=-1;
+    uf_union(ref->start, ref->n+usr->start);
+    pairs[tail]=(PairNode){ ref->start, usr->start, -1, -1 };
+    if(ref->acc[ref->start]!=usr->acc[usr->start]) bad=tail;
+    tail++;
+
+    while(bad<0 && head<tail){
+        const int node=head++;
+        const int p=pairs[node].p, q=pairs[node].q;
+        if(steps_spend(k)) die("step budget exceeded");
+        for(int a=0;a<k;a++){
+            int p2=(int)dfa_next(ref,(uint32_t)p,a);
+            int q2=(int)dfa_next(usr,(uint32_t)q,a);
+            if(!uf_union(p2, ref->n+q2)) continue;
+            pairs[tail]=(PairNode){ p2, q2, node, a };
+            if(ref->acc[p2]!=usr->acc[q2]){ bad=tail++; break; }
+            tail++;
+        }
+    }
+
+    equiv_pairs=tail;
+    if(bad<0){
+        fprintf(out,"PASS: user DFA is equivalent to reference DFA (%d state pairs explored).\n", tail);
+        equiv_free();
+        return 0;
+    }
+
+    int len=0;
+    for(int i=bad;pairs[i].from>=0;i=pairs[i].from) len++;
+    cex=(char*)xmalloc((size_t)len+1);
+    cex[len]='\0';
+    for(int i=bad, j=len;pairs[i].from>=0;i=pairs[i].from) cex[--j]=ref->alphabet[pairs[i].sym];
 
-    dfa_free(&ref); dfa_free(&usr);
+    fprintf(errs(),"FAIL: user DFA and reference DFA accept different languages\n");
+    fprintf(errs(),"  w = %s\n", len==0 ? "<eps>" : cex);
+    fprintf(errs(),"  ref_accept = %d, user_accept = %d\n", ref->acc[pairs[bad].p], usr->acc[pairs[bad].q]);
+    equiv_free();
+    return 2;
+}
+
+/* ===== --stats ===== */
+
+static void stats_reset(void){
+    load_ms=check_ms=0;
+    sim_strings=sim_bytes=0;
+    tests_run=equiv_pairs=ref_cached=0;
+    sim_kernel="none";
+}
+
+/* One "STATS <json>" line on stderr after a check ran. */
+static void print_stats(int equiv, const DFA* ref, const DFA* usr){
+    fprintf(errs(),"STATS {\"tool\":\"dfa_checker\",\"mode\":\"%s\",\"load_ms\":%.3f,\"check_ms\":%.3f,"
+            "\"total_ms\":%.3f,\"ref_states\":%d,\"user_states\":%d,\"ref_cached\":%d,\"tests\":%d,"
+            "\"strings\":%ld,\"bytes\":%ld,\"kernel\":\"%s\",\"equiv_pairs\":%d}\n",
+            equiv ? "equiv" : report.on ? "report" : "tests",load_ms,check_ms,load_ms+check_ms,ref->n,usr->n,ref_cached,tests_run,
+            sim_strings,sim_bytes,sim_kernel,equiv_pairs);
+}
+
+/* Runs the selected check, timing it; returns the tool's exit code. */
+static int run_check(int equiv, DFA* ref, DFA* usr, const char* tests, size_t tests_len, FILE* out){
+    double t0=now_ms();
+    tests_run=0;
+    int code=equiv ? check_equiv(ref,usr,out) : check_dfas(ref,usr,tests,tests_len,out);
+    test_reader_close(&reader);
+    check_ms=now_ms()-t0;
+    if(show_stats) print_stats(equiv,ref,usr);
+    return code;
+}
+
+/* ===== --serve ===== */
+
+/* Parsed reference DFAs by key, least recently used entry is evicted. */
+#define REF_CACHE_SLOTS 32
+typedef struct { char* key; DFA dfa; unsigned long used; } RefEntry;
+static TOOL_LOCAL RefEntry ref_cache[REF_CACHE_SLOTS];
+static TOOL_LOCAL unsigned long ref_clock=0;
+
+static DFA* ref_lookup(const char* key, const char* ref, size_t ref_len){
+    if(key[0]=='\0'){
+        dfa_load_mem(ref,ref_len,&ref_dfa);
+        return &ref_dfa;
+    }
+    RefEntry* victim=&ref_cache[0];
+    for(int i=0;i<REF_CACHE_SLOTS;i++){
+        RefEntry* e=&ref_cache[i];
+        if(e->key && strcmp(e->key,key)==0){
+            e->used=++ref_clock;
+            ref_cached=1;
+            return &e->dfa;
+        }
+        if(e->used < victim->used) victim=e; /* empty slots have used == 0 */
+    }
+
+    /* parse into the file-scope scratch first so a die() leaves the cache intact */
+    dfa_load_mem(ref,ref_len,&ref_dfa);
+    size_t n=strlen(key);
+    char* k=(char*)xmalloc(n+1);
+    memcpy(k,key,n+1);
+    free(victim->key);
+    dfa_free(&victim->dfa);
+    victim->key=k;
+    victim->dfa=ref_dfa;
+    memset(&ref_dfa,0,sizeof(ref_dfa));
+    victim->used=++ref_clock;
+    return &victim->dfa;
+}
+
+/*
+  Editor sessions (--session ID): the user DFA stays in the worker as a partial table
+  and each request carries only edits to it, one per line:
+    reset            empty table (a new session must start with it)
+    s <q>            start state, "-" for q clears it
+    a <q> 0|1        accepting or not
+    t <q> <c> <r>    transition on symbol c to r, "-" for r removes it
+  States are numbers below SESSION_MAX_STATES. The table is completed with a dead
+  state for each check, so only the partial table is kept. A session without a
+  start state answers "Error: session: no start state"; any other failed request
+  drops its session, and the server replays its log from reset.
+
+  In the addon the sessions are shared by every calling thread, so any thread can
+  serve an editor; a request holds session_lock while it edits its session and
+  copies out the table, not while the check runs.
+*/
+#define SESSION_SLOTS 64
+#define SESSION_MAX_STATES 4096
+typedef struct {
+    char* id;
+    unsigned long used;
+    int n, cap, start;      /* n = 1 + highest state named so far */
+    unsigned char* acc;     /* cap entries */
+    int* trans;             /* cap*k, -1 => missing */
+} Session;
+static Session sessions[SESSION_SLOTS];
+static unsigned long session_clock=0;
+
+#ifdef GRADER_LIBRARY
+static pthread_mutex_t session_lock=PTHREAD_MUTEX_INITIALIZER;
+static void sessions_lock(void){ pthread_mutex_lock(&session_lock); }
+static void sessions_unlock(void){ pthread_mutex_unlock(&session_lock); }
+#else
+static void sessions_lock(void){}
+static void sessions_unlock(void){}
+#endif
+
+static void session_clear(Session* se){
+    free(se->acc); free(se->trans);
+    se->acc=NULL; se->trans=NULL;
+    se->n=se->cap=0;
+    se->start=-1;
+}
+
+static void session_drop(Session* se){
+    session_clear(se);
+    free(se->id);
+    se->id=NULL;
+    se->used=0;
+}
+
+static Session* session_find(const char* id){
+    for(int i=0;i<SESSION_SLOTS;i++) if(sessions[i].id && strcmp(sessions[i].id,id)==0) return &sessions[i];
+    return NULL;
+}
+
+/* The session's slot, taking the least recently used one for a new id. */
+static Session* session_open(const char* id){
+    Session* se=session_find(id);
+    if(se) return se;
+    se=&sessions[0];
+    for(int i=1;i<SESSION_SLOTS;i++) if(sessions[i].used < se->used) se=&sessions[i];
+    session_drop(se);
+    size_t n=strlen(id);
+    se->id=(char*)xmalloc(n+1);
+    memcpy(se->id,id,n+1);
+    se->start=-1;
+    return se;
+}
+
+static void session_grow(Session* se, int q, int k){
+    if(q<0 || q>=SESSION_MAX_STATES) die("session: state number out of range");
+    if(q>=se->cap){
+        int cap=se->cap ? se->cap : 16;
+        while(cap<=q) cap*=2;
+        unsigned char* na=(unsigned char*)realloc(se->acc,(size_t)cap);
+        if(!na) die("out of memory");
+        se->acc=na;
+        int* nt=(int*)realloc(se->trans,(size_t)cap*(size_t)k*sizeof(int));
+        if(!nt) die("out of memory");
+        se->trans=nt;
+        memset(se->acc+se->cap,0,(size_t)(cap-se->cap));
+        for(size_t i=(size_t)se->cap*k;i<(size_t)cap*k;i++) se->trans[i]=-1;
+        se->cap=cap;
+    }
+    if(q>=se->n) se->n=q+1;
+}
+
+static int parse_state(const char** p){
+    char* e=NULL;
+    long v=strtol(*p,&e,10);
+    if(e==*p) die("session: bad state number");
+    *p=e;
+    return v<0 || v>=SESSION_MAX_STATES ? -1 : (int)v;
+}
+
+/* Applies one request's edit script; ref gives the alphabet. */
+static void session_edit(Session* se, const DFA* ref, const char* p, size_t len){
+    const char* end=p+len;
+    int k=ref->k;
+    while(p<end){
+        const char* e=memchr(p,'\n',(size_t)(end-p));
+        if(!e) e=end;
+        const char* q=p;
+        while(q<e && (*q==' ' || *q=='\r')) q++;
+        if(q==e){ p=e+1; continue; }
+        char op=*q++;
+        if(op=='r' && (size_t)(e-q)>=4 && memcmp(q,"eset",4)==0){
+            session_clear(se);
+        } else if(op=='s'){
+            while(q<e && *q==' ') q++;
+            if(q<e && *q=='-'){
+                se->start=-1;
+            } else {
+                int st=parse_state(&q);
+                session_grow(se,st,k);
+                se->start=st;
+            }
+        } else if(op=='a'){
+            int st=parse_state(&q);
+            session_grow(se,st,k);
+            while(q<e && *q==' ') q++;
+            if(q==e || (*q!='0' && *q!='1')) die("session: bad accept edit");
+            se->acc[st]=(unsigned char)(*q-'0');
+        } else if(op=='t'){
+            int from=parse_state(&q);
+            session_grow(se,from,k);
+            if(q+2>e || *q!=' ') die("session: bad transition edit");
+            int c=ref->col[(unsigned char)q[1]];
+            if(c<0) die("session: symbol not in alphabet");
+            q+=2;
+            while(q<e && *q==' ') q++;
+            if(q<e && *q=='-'){
+                se->trans[(size_t)from*k+c]=-1;
+            } else {
+                int to=parse_state(&q);
+                session_grow(se,to,k);
+                se->trans[(size_t)from*k+c]=to;
+            }
+        } else {
+            die("session: unknown edit");
+        }
+        p=e+1;
+    }
+}
+
+/* The session's table completed with a dead state, as dfa2table would write it. */
+static void session_dfa(const Session* se, const DFA* ref, DFA* d){
+    int k=ref->k, n=se->n+1, dead=se->n;
+    memset(d,0,sizeof(*d));
+    d->k=k;
+    d->alphabet=(char*)xmalloc((size_t)k+1);
+    memcpy(d->alphabet,ref->alphabet,(size_t)k+1);
+    d->n=n;
+    d->start=se->start;
+    d->acc=(unsigned char*)xmalloc((size_t)n);
+    d->trans=(int*)xmalloc((size_t)n*(size_t)k*sizeof(int));
+    memcpy(d->acc,se->acc,(size_t)se->n);
+    d->acc[dead]=0;
+    for(size_t i=0;i<(size_t)se->n*k;i++) d->trans[i] = se->trans[i]>=0 ? se->trans[i] : dead;
+    for(int a=0;a<k;a++) d->trans[(size_t)dead*k+a]=dead;
+    dfa_finish(d);
+}
+
+/* Per-request options field: space separated command line flags (--equiv, --report,
+   --stats, --session ID, --close). */
+static int parse_options(char* opts, int* stats, const char** session, int* close_session){
+    int equiv=0;
+    report_reset(0);
+    char* save=NULL;
+    for(char* t=strtok_r(opts," \t\r\n",&save); t; t=strtok_r(NULL," \t\r\n",&save)){
+        if(strcmp(t,"--equiv")==0) equiv=1;
+        else if(strcmp(t,"--report")==0) report.on=1;
+        else if(strcmp(t,"--close")==0) *close_session=1;
+        else if(strcmp(t,"--session")==0){
+            *session=strtok_r(NULL," \t\r\n",&save);
+            if(!*session) die("serve: --session needs an id");
+        }
+        else if(strcmp(t,"--stats")==0) *stats=1;
+        else die("serve: unknown option");
+    }
+    return equiv;
+}
+
+/* Forgets session id, if it is still kept. */
+static void session_close(const char* id){
+    sessions_lock();
+    Session* se=session_find(id);
+    if(se) session_drop(se);
+    sessions_unlock();
+}
+
+/* What a request holds when a die() ends it. */
+typedef struct {
+    const char* failed_session; /* dropped if the request dies */
+    int locked;
+} Request;
+
+static void serve_unwind(void* ctx){
+    Request* rq=(Request*)ctx;
+    if(rq->locked) sessions_unlock();
+    if(rq->failed_session) session_close(rq->failed_session);
+    dfa_free(&ref_dfa); dfa_free(&usr_dfa);
+    equiv_free();
+    batch_free();
+    test_reader_close(&reader);
+    report_reset(0);
+}
+
+/* One request of the SERVE PROTOCOL; a die() ends it through serve_unwind(). */
+static int serve_one(void* ctx, char** fields, const size_t* lens, FILE* fin, FILE* fout, FILE* ferr){
+    Request* rq=(Request*)ctx;
+    (void)fin;
+    rq->failed_session=NULL;
+    rq->locked=0;
+    int stats=show_stats, close_session=0;
+    const char* session=NULL;
+    int equiv=parse_options(fields[0],&stats,&session,&close_session);
+    if(session && close_session){
+        session_close(session);
+        return 0;
+    }
+    stats_reset();
+    double t0=now_ms();
+    DFA* rp=ref_lookup(fields[1],fields[2],lens[2]);
+    if(session){
+        sessions_lock();
+        rq->locked=1;
+        Session* se=session_find(session);
+        if(!se && (lens[3]<5 || memcmp(fields[3],"reset",5)!=0)) die("session not found");
+        rq->failed_session=session;
+        if(!se) se=session_open(session);
+        se->used=++session_clock;
+        session_edit(se,rp,fields[3],lens[3]);
+        if(se->start<0){
+            /* a DFA still being drawn; keep the session */
+            sessions_unlock();
+            fprintf(ferr,"Error: session: no start state\n");
+            dfa_free(&ref_dfa);
+            return 1;
+        }
+        session_dfa(se,rp,&usr_dfa);
+        sessions_unlock();
+        rq->locked=0;
+    } else {
+        dfa_load_mem(fields[3],lens[3],&usr_dfa);
+    }
+    load_ms=now_ms()-t0;
+    int saved=show_stats;
+    show_stats=stats;
+    int code=run_check(equiv,rp,&usr_dfa,fields[4],lens[4],fout);
+    show_stats=saved;
+    dfa_free(&ref_dfa); dfa_free(&usr_dfa);
+    report_reset(0);
+    return code;
+}
+
+static ServeTool serve_tool(Request* rq){
+    ServeTool t={ 5, -1, serve_one, serve_unwind, rq, &die_jmp, &err_out };
+    return t;
+}
+
+#ifdef GRADER_LIBRARY
+
+/* ===== in-process requests (see automata.h) =====
+   The reference cache is per thread; sessions are shared (see "Editor sessions"). */
+
+int dfa_checker_call(const char* flags, char** fields, const size_t* lens, ToolOutput* o){
+    show_stats=has_flag(flags,"--stats");
+    Request rq;
+    ServeTool t=serve_tool(&rq);
+    return serve_call(&t,fields,lens,o);
+}
+
+#else
+
+static int serve(void){
+    Request rq;
+    ServeTool t=serve_tool(&rq);
+    const char* err=serve_requests(&t);
+    if(err) die(err);
     return 0;
 }
+
+int main(int argc, char** argv){
+    MappedFile mref, musr, mtests={0};
+    int argi=1;
+    for(; argi<argc && strcmp(argv[argi],"--stats")==0; argi++) show_stats=1;
+    const int nargs=argc-argi;
+    char** args=argv+argi;
+
+    if(nargs == 1 && strcmp(args[0],"--serve")==0) return serve();
+    if(nargs == 3 && strcmp(args[0],"--binary")==0){
+        dfa_map(args[1],&mref);
+        dfa_load_mem((const char*)mref.data,mref.len,&ref_dfa);
+        FILE* out = open_stream(args[2],"wb");
+        if(!out) die("cannot open output file");
+        if(dfab_write(out,ref_dfa.k,ref_dfa.alphabet,ref_dfa.n,ref_dfa.start,ref_dfa.acc,dfa_trans(&ref_dfa))!=0 || close_stream(out)!=0)
+            die("cannot write output file");
+        unmap_file(&mref);
+        dfa_free(&ref_dfa);
+        return 0;
+    }
+    const int equiv = nargs == 3 && strcmp(args[0],"--equiv")==0;
+    const int full = nargs == 4 && strcmp(args[0],"--report")==0;
+    if(equiv || full){
+        args++;
+        report_reset(full);
+    } else if(nargs != 3){
+        fprintf(stderr,"Usage: %s [--stats] [--report] <ref.dfa> <user.dfa> <tests.txt>\n", argv[0]);
+        fprintf(stderr,"       %s [--stats] --equiv <ref.dfa> <user.dfa>\n", argv[0]);
+        fprintf(stderr,"       %s --binary <in.dfa> <out.dfa>\n", argv[0]);
+        fprintf(stderr,"       %s [--stats] --serve\n", argv[0]);
+        return 1;
+    }
+
+    dfa_map(args[0],&mref);
+    dfa_map(args[1],&musr);
+    if(!equiv && map_file(args[2],&mtests)) die("cannot open tests file");
+
+    double t0 = now_ms();
+    dfa_load_mem((const char*)mref.data,mref.len,&ref_dfa);
+    dfa_load_mem((const char*)musr.data,musr.len,&usr_dfa);
+    load_ms = now_ms() - t0;
+    int code = run_check(equiv,&ref_dfa,&usr_dfa,(const char*)mtests.data,mtests.len,stdout);
+
+    unmap_file(&mref); unmap_file(&musr); unmap_file(&mtests);
+    dfa_free(&ref_dfa); dfa_free(&usr_dfa);
+    batch_free();
+    report_reset(0);
+    return code;
+}
+
+#endif /* GRADER_LIBRARY */
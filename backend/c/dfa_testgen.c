@@ -0,0 +1,403 @@
+/*
+  dfa_testgen.c
+
+  PURPOSE
+    Generate a tests file from a reference .dfa (W-method). The tests are
+      P . Sigma^{<=m} . W
+    where P is the transition cover (the shortest access string of every state, and
+    each of those followed by every symbol), Sigma^{<=m} all strings of at most
+    m = --extra symbols, and W a characterization set: for every two states of the
+    minimal reference some suffix in W is accepted from one and not the other.
+    Every label is the reference's verdict.
+
+    A user DFA with at most (reference states + m) states that passes all of them
+    accepts exactly the reference language, so m bounds how far off a submission may
+    be in size and still be caught.
+
+  HOW W IS BUILT
+    The reference is first minimized (automata.c). A Moore refinement then records,
+    level by level, which states are still equivalent on strings of length <= i; from
+    it a shortest string telling any two states apart is read back symbol by symbol.
+    Starting from one block, W grows by the string that separates two states of a
+    block still holding several, and all blocks are refined by it, until every state
+    is alone: |W| <= states - 1. The empty string is always in W.
+
+  OUTPUT
+    A tests file in the dfa_checker format (<eps> for the empty string), ordered by
+    length and then alphabet order, preceded by a # comment with the parameters.
+    Exit code: 0 on success, 1 on a usage or input error (including a test set larger
+    than --max).
+
+  COMPILE
+    gcc -O2 -Wall -Wextra -std=c11 dfa_testgen.c automata.c -lz -o dfa_testgen
+
+  RUN
+    ./dfa_testgen [--stats] [--extra M] [--max N] <ref.dfa> <tests.txt>
+    --extra defaults to 0, --max (tests written) to 1000000.
+    ref.dfa may be - (stdin) or /dev/fd/N, tests.txt may be - (stdout).
+
+    --stats ends stderr with one line
+      STATS {"tool":"dfa_testgen","load_ms":..,"gen_ms":..,"write_ms":..,"total_ms":..,
+             "states":..,"min_states":..,"w_size":..,"tests":..}
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "automata.h"
+
+static void die(const char* msg){
+    fprintf(stderr,"Error: %s\n", msg);
+    exit(1);
+}
+static void* xmalloc(size_t n){ void* p=malloc(n); if(!p) die("out of memory"); return p; }
+static void* xcalloc(size_t n,size_t s){ void* p=calloc(n,s); if(!p) die("out of memory"); return p; }
+static void* xrealloc(void* p,size_t n){ void* q=realloc(p,n); if(!q) die("out of memory"); return q; }
+
+static double now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec*1e3 + (double)ts.tv_nsec/1e6;
+}
+
+/* ===== minimal reference ===== */
+static int K, N, S;             /* alphabet size, states, start (always 0 after minimize) */
+static int* tr;                 /* N*K */
+static unsigned char* acc;      /* N */
+
+/* Reads the complete DFA and replaces it by its minimal, BFS numbered equivalent. */
+static void load_minimal(const DfaTable* t){
+    int* id=(int*)xmalloc((size_t)t->n*sizeof(int));
+    int n=0;
+    const char* err=dfa_reachable(t->n,t->k,t->trans,t->start,id,&n);
+    if(err) die(err);
+    int* rt=(int*)xmalloc((size_t)n*(size_t)t->k*sizeof(int));
+    unsigned char* ra=(unsigned char*)xmalloc((size_t)n);
+    for(int s=0;s<t->n;s++){
+        if(id[s]<0) continue;
+        ra[id[s]]=t->acc[s];
+        for(int a=0;a<t->k;a++) rt[(size_t)id[s]*t->k+a]=id[t->trans[(size_t)s*t->k+a]];
+    }
+    free(id);
+
+    int* cls=(int*)xmalloc((size_t)n*sizeof(int));
+    err=dfa_minimize(n,t->k,rt,ra,0,cls,&N,NULL);
+    if(err) die(err);
+    K=t->k;
+    S=0;
+    tr=(int*)xmalloc((size_t)N*(size_t)K*sizeof(int));
+    acc=(unsigned char*)xcalloc((size_t)N,1);
+    unsigned char* done=(unsigned char*)xcalloc((size_t)N,1);
+    for(int s=0;s<n;s++){
+        int c=cls[s];
+        if(done[c]) continue;
+        done[c]=1;
+        acc[c]=ra[s];
+        for(int a=0;a<K;a++) tr[(size_t)c*K+a]=cls[rt[(size_t)s*K+a]];
+    }
+    free(done); free(cls); free(rt); free(ra);
+}
+
+static int run_from(int s, const unsigned char* w, int len){
+    for(int i=0;i<len;i++) s=tr[(size_t)s*K+w[i]];
+    return s;
+}
+
+/* ===== words (strings of symbol indices) ===== */
+typedef struct { int off, len; } Word;
+typedef struct { unsigned char* buf; size_t len, cap; Word* w; int n, cap_w; } WordSet;
+
+static int ws_add(WordSet* ws, const unsigned char* p, int len){
+    if(ws->len+(size_t)len > ws->cap){
+        size_t cap=ws->cap ? ws->cap : 4096;
+        while(cap < ws->len+(size_t)len) cap*=2;
+        ws->buf=(unsigned char*)xrealloc(ws->buf,cap);
+        ws->cap=cap;
+    }
+    if(ws->n==ws->cap_w){
+        ws->cap_w=ws->cap_w ? ws->cap_w*2 : 64;
+        ws->w=(Word*)xrealloc(ws->w,(size_t)ws->cap_w*sizeof(Word));
+    }
+    if(ws->len > INT32_MAX-(size_t)len) die("test set too large");
+    if(len) memcpy(ws->buf+ws->len,p,(size_t)len);
+    ws->w[ws->n]=(Word){ (int)ws->len, len };
+    ws->len+=(size_t)len;
+    return ws->n++;
+}
+
+static const unsigned char* ws_at(const WordSet* ws, int i){ return ws->buf+ws->w[i].off; }
+
+/* ===== access strings (BFS tree from the start) ===== */
+static int* par_state;          /* BFS parent, -1 for the start */
+static unsigned char* par_sym;
+static int* depth;
+
+static void build_access(void){
+    par_state=(int*)xmalloc((size_t)N*sizeof(int));
+    par_sym=(unsigned char*)xmalloc((size_t)N);
+    depth=(int*)xmalloc((size_t)N*sizeof(int));
+    int* q=(int*)xmalloc((size_t)N*sizeof(int));
+    for(int s=0;s<N;s++) depth[s]=-1;
+    int qh=0, qt=0;
+    depth[S]=0; par_state[S]=-1; par_sym[S]=0;
+    q[qt++]=S;
+    while(qh<qt){
+        int s=q[qh++];
+        for(int a=0;a<K;a++){
+            int t=tr[(size_t)s*K+a];
+            if(depth[t]>=0) continue;
+            depth[t]=depth[s]+1; par_state[t]=s; par_sym[t]=(unsigned char)a;
+            q[qt++]=t;
+        }
+    }
+    free(q);
+}
+
+/* Writes the access string of s into out (depth[s] symbols). */
+static void access_string(int s, unsigned char* out){
+    for(int i=depth[s]-1;i>=0;i--){ out[i]=par_sym[s]; s=par_state[s]; }
+}
+
+/* ===== characterization set ===== */
+/* Moore levels: lvl[i*N+s] is the class of s under strings of length <= i. */
+static int* lvl;
+static int n_levels;
+
+static void build_levels(void){
+    int cap=4;
+    lvl=(int*)xmalloc((size_t)cap*(size_t)N*sizeof(int));
+    for(int s=0;s<N;s++) lvl[s]=acc[s];
+    int classes = 1;
+    for(int s=0;s<N;s++) if(acc[s]!=acc[0]){ classes=2; break; }
+    n_levels=1;
+
+    /* signature hash table: (previous class, successor classes) -> new class */
+    int hcap=1;
+    while(hcap < 2*N) hcap<<=1;
+    int* head=(int*)xmalloc((size_t)hcap*sizeof(int));
+    int* rep=(int*)xmalloc((size_t)N*sizeof(int));
+    for(;;){
+        if(n_levels==cap){
+            cap*=2;
+            lvl=(int*)xrealloc(lvl,(size_t)cap*(size_t)N*sizeof(int));
+        }
+        const int* prev=lvl+(size_t)(n_levels-1)*N;
+        int* cur=lvl+(size_t)n_levels*N;
+        for(int i=0;i<hcap;i++) head[i]=-1;
+        int nc=0;
+        for(int s=0;s<N;s++){
+            uint64_t h=(uint64_t)prev[s]*0x9E3779B97F4A7C15ull;
+            for(int a=0;a<K;a++) h=(h^(uint64_t)prev[tr[(size_t)s*K+a]])*0x100000001B3ull;
+            int i=(int)(h&(uint64_t)(hcap-1));
+            for(;;){
+                if(head[i]<0){ head[i]=nc; rep[nc]=s; cur[s]=nc++; break; }
+                int r=rep[head[i]];
+                int same = prev[r]==prev[s];
+                for(int a=0;a<K && same;a++) same = prev[tr[(size_t)r*K+a]]==prev[tr[(size_t)s*K+a]];
+                if(same){ cur[s]=head[i]; break; }
+                i=(i+1)&(hcap-1);
+            }
+        }
+        n_levels++;
+        if(nc==classes) break;
+        classes=nc;
+    }
+    free(head); free(rep);
+    if(classes!=N) die("internal error: minimized reference has equivalent states");
+}
+
+/* A shortest string accepted from exactly one of s and t (s, t distinct). */
+static int separate(int s, int t, unsigned char* out){
+    int i=0;
+    while(lvl[(size_t)i*N+s]==lvl[(size_t)i*N+t]) i++;
+    int len=0;
+    for(;i>0;i--){
+        const int* prev=lvl+(size_t)(i-1)*N;
+        int a=0;
+        while(prev[tr[(size_t)s*K+a]]==prev[tr[(size_t)t*K+a]]) a++;
+        out[len++]=(unsigned char)a;
+        s=tr[(size_t)s*K+a];
+        t=tr[(size_t)t*K+a];
+    }
+    return len;
+}
+
+/* Fills W: states are refined by acceptance after each word until all are apart. */
+static void build_w(WordSet* W){
+    ws_add(W,NULL,0);
+    int* part=(int*)xcalloc((size_t)N,sizeof(int));
+    int* next=(int*)xmalloc((size_t)N*sizeof(int));
+    int* map=(int*)xmalloc((size_t)2*N*sizeof(int));
+    unsigned char* w=(unsigned char*)xmalloc((size_t)n_levels+1);
+    int blocks=1;
+    /* the empty word already splits by acceptance */
+    for(int s=0;s<N;s++) part[s]=acc[s];
+    if(N>1) blocks=2;
+    while(blocks<N){
+        /* two states of one block: the first state whose block was seen before */
+        int* seen=map;
+        for(int b=0;b<blocks;b++) seen[b]=-1;
+        int s=-1, t=-1;
+        for(int x=0;x<N && s<0;x++){
+            if(seen[part[x]]>=0){ s=seen[part[x]]; t=x; }
+            else seen[part[x]]=x;
+        }
+        int len=separate(s,t,w);
+        ws_add(W,w,len);
+
+        for(int i=0;i<2*blocks;i++) map[i]=-1;
+        int nb=0;
+        for(int x=0;x<N;x++){
+            int key=part[x]*2+acc[run_from(x,w,len)];
+            if(map[key]<0) map[key]=nb++;
+            next[x]=map[key];
+        }
+        memcpy(part,next,(size_t)N*sizeof(int));
+        blocks=nb;
+    }
+    free(part); free(next); free(map); free(w);
+}
+
+/* ===== test set ===== */
+static WordSet tests;
+static long max_tests=1000000;
+static unsigned* th=NULL;       /* open addressing: test index + 1, 0 = empty */
+static size_t th_cap=0;
+
+static uint64_t word_hash(const unsigned char* p, int len){
+    uint64_t h=1469598103934665603ull;
+    for(int i=0;i<len;i++) h=(h^p[i])*1099511628211ull;
+    return h^(uint64_t)len;
+}
+
+static void th_insert_index(int i){
+    size_t m=th_cap-1, j=(size_t)word_hash(ws_at(&tests,i),tests.w[i].len)&m;
+    while(th[j]) j=(j+1)&m;
+    th[j]=(unsigned)i+1;
+}
+
+static void add_test(const unsigned char* p, int len){
+    if((size_t)(tests.n+1)*2 > th_cap){
+        free(th);
+        th_cap = th_cap ? th_cap*2 : 1024;
+        th=(unsigned*)xcalloc(th_cap,sizeof(unsigned));
+        for(int i=0;i<tests.n;i++) th_insert_index(i);
+    }
+    size_t m=th_cap-1, j=(size_t)word_hash(p,len)&m;
+    for(; th[j]; j=(j+1)&m){
+        const Word* w=&tests.w[th[j]-1];
+        if(w->len==len && memcmp(tests.buf+w->off,p,(size_t)len)==0) return;
+    }
+    if(tests.n >= max_tests) die("test set would exceed --max; lower --extra");
+    th[j]=(unsigned)ws_add(&tests,p,len)+1;
+}
+
+/* Every p . mid . w, p in the transition cover, |mid| <= extra, w in W. */
+static void build_tests(const WordSet* W, int extra){
+    int max_w=0;
+    for(int i=0;i<W->n;i++) if(W->w[i].len>max_w) max_w=W->w[i].len;
+    int max_d=0;
+    for(int s=0;s<N;s++) if(depth[s]>max_d) max_d=depth[s];
+    unsigned char* buf=(unsigned char*)xmalloc((size_t)max_d+1+(size_t)extra+(size_t)max_w+1);
+    int* mid=(int*)xmalloc(((size_t)extra+1)*sizeof(int));
+
+    for(int s=0;s<N;s++){
+        for(int a=-1;a<K;a++){
+            access_string(s,buf);
+            int plen=depth[s];
+            if(a>=0) buf[plen++]=(unsigned char)a;
+            for(int ml=0;ml<=extra;ml++){
+                for(int i=0;i<ml;i++) mid[i]=0;
+                for(;;){
+                    for(int i=0;i<ml;i++) buf[plen+i]=(unsigned char)mid[i];
+                    for(int wi=0;wi<W->n;wi++){
+                        memcpy(buf+plen+ml,ws_at(W,wi),(size_t)W->w[wi].len);
+                        add_test(buf,plen+ml+W->w[wi].len);
+                    }
+                    int i=ml-1;
+                    while(i>=0 && ++mid[i]==K) mid[i--]=0;
+                    if(i<0) break;
+                }
+            }
+        }
+    }
+    free(buf); free(mid);
+}
+
+static int cmp_test(const void* x, const void* y){
+    const Word* a=&tests.w[*(const int*)x];
+    const Word* b=&tests.w[*(const int*)y];
+    if(a->len!=b->len) return a->len<b->len ? -1 : 1;
+    return memcmp(tests.buf+a->off,tests.buf+b->off,(size_t)a->len);
+}
+
+static void write_tests(FILE* out, const DfaTable* t, const char* ref_path, int extra, int w_size){
+    int* order=(int*)xmalloc((size_t)tests.n*sizeof(int));
+    for(int i=0;i<tests.n;i++) order[i]=i;
+    qsort(order,(size_t)tests.n,sizeof(int),cmp_test);
+
+    fprintf(out,"# dfa_testgen %s: W-method, %d states, |W| = %d, extra = %d, %d tests\n",
+            ref_path,N,w_size,extra,tests.n);
+    for(int i=0;i<tests.n;i++){
+        const Word* w=&tests.w[order[i]];
+        const unsigned char* p=tests.buf+w->off;
+        fprintf(out,"%d ",acc[run_from(S,p,w->len)]);
+        if(w->len==0) fputs("<eps>",out);
+        for(int j=0;j<w->len;j++) fputc(t->alphabet[p[j]],out);
+        fputc('\n',out);
+    }
+    free(order);
+}
+
+int main(int argc, char** argv){
+    int argi=1, show_stats=0, extra=0;
+    for(; argi<argc && strncmp(argv[argi],"--",2)==0; argi++){
+        if(strcmp(argv[argi],"--stats")==0) show_stats=1;
+        else if(strcmp(argv[argi],"--extra")==0 && argi+1<argc) extra=atoi(argv[++argi]);
+        else if(strcmp(argv[argi],"--max")==0 && argi+1<argc) max_tests=atol(argv[++argi]);
+        else break;
+    }
+    if(argc-argi != 2 || extra<0 || max_tests<1){
+        fprintf(stderr,"Usage: %s [--stats] [--extra M] [--max N] <ref.dfa> <tests.txt>\n", argv[0]);
+        return 1;
+    }
+
+    double t0=now_ms();
+    MappedFile m;
+    if(map_file(argv[argi],&m)) die("cannot open reference DFA file");
+    DfaTable t;
+    const char* err=dfa_table_load(m.data,m.len,&t);
+    if(err) die(err);
+    unmap_file(&m);
+    double t1=now_ms();
+
+    load_minimal(&t);
+    build_access();
+    build_levels();
+    WordSet W={0};
+    build_w(&W);
+    build_tests(&W,extra);
+    double t2=now_ms();
+
+    FILE* out=open_stream(argv[argi+1],"w");
+    if(!out) die("cannot open output file");
+    write_tests(out,&t,argv[argi],extra,W.n);
+    if(close_stream(out)!=0) die("cannot write output file");
+    double t3=now_ms();
+
+    if(show_stats){
+        fprintf(stderr,"STATS {\"tool\":\"dfa_testgen\",\"load_ms\":%.3f,\"gen_ms\":%.3f,\"write_ms\":%.3f,"
+                "\"total_ms\":%.3f,\"states\":%d,\"min_states\":%d,\"w_size\":%d,\"tests\":%d}\n",
+                t1-t0,t2-t1,t3-t2,t3-t0,t.n,N,W.n,tests.n);
+    }
+
+    dfa_table_free(&t);
+    free(tr); free(acc); free(par_state); free(par_sym); free(depth); free(lvl);
+    free(W.buf); free(W.w); free(tests.buf); free(tests.w); free(th);
+    return 0;
+}
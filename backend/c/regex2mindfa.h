@@ -0,0 +1,56 @@
+/*
+  regex2mindfa.h
+
+  PURPOSE
+    The regex2mindfa pipeline for tools that compile regexes themselves
+    (bench_compiler, build_problems). A Compiler holds one compilation at a time and
+    the memory it keeps for the next (see "compilation memory" in
+    regex2mindfa_compiler.c). Compilers share nothing, so several can compile at once
+    on different threads, and a Compiler may be used from one thread, then another.
+
+  COMPILE
+    Link regex2mindfa_compiler.c built with -DREGEX2MINDFA_NO_MAIN, automata.c and zlib, e.g.
+      gcc -O2 -Wall -Wextra -std=c11 -pthread -DREGEX2MINDFA_NO_MAIN bench_compiler.c regex2mindfa_compiler.c automata.c -lz -o bench_compiler
+*/
+#ifndef REGEX2MINDFA_H
+#define REGEX2MINDFA_H
+
+#include <stdio.h>
+
+typedef struct Compiler Compiler;
+
+/* regex2mindfa's command line flags; compiler_options_default() sets the tool's defaults. */
+typedef struct {
+    int binary;             /* --binary */
+    int glushkov;           /* --glushkov */
+    int simplify;           /* 0 for --no-simplify */
+    int bitparallel;        /* 0 for --no-bitparallel (--check only) */
+    int threads;            /* --threads, 1 .. 64 */
+    long max_nfa_states, max_dfa_states, max_bytes; /* budgets, 0 = none */
+} CompilerOptions;
+
+void compiler_options_default(CompilerOptions* o);
+
+/* NULL when out of memory. */
+Compiler* compiler_new(const CompilerOptions* o);
+void compiler_set_options(Compiler* c, const CompilerOptions* o);
+void compiler_free(Compiler* c);
+
+/* Compiles a regex2mindfa input file (regex line, alphabet line) read from in to its
+   minimized DFA, kept in c until the next compilation. Errors are written to err as
+   the tool writes them (a BUDGET line, then "Error: ..."). Returns the tool's exit
+   code: 0, 1, or STEPS_EXCEEDED_EXIT (automata.h) when a budget or the calling thread's
+   step budget ran out. */
+int compiler_compile(Compiler* c, FILE* in, FILE* err);
+/* Writes the last compiled DFA to out, as text or --binary; returns as compiler_compile(). */
+int compiler_write(Compiler* c, FILE* out, FILE* err);
+
+/* The figures of the tool's STATS line for the last compilation. */
+typedef struct {
+    double parse_ms, nfa_ms, dfa_ms, min_ms, write_ms;
+    int nfa_states, dfa_states, min_states;
+} CompilerStats;
+
+void compiler_stats(const Compiler* c, CompilerStats* st);
+
+#endif
@@ -36,43 +36,348 @@
     ...
     END
 
+    With --binary the same DFA is written in the binary format described in automata.h.
+
   COMPILE
-    gcc -O2 -Wall -Wextra -std=c11 regex2mindfa_compiler.c -o regex2mindfa
+    gcc -O2 -Wall -Wextra -std=c11 -pthread regex2mindfa_compiler.c automata.c -lz -o regex2mindfa
+    Built with -DREGEX2MINDFA_NO_MAIN it is the pipeline of regex2mindfa.h only, for
+    bench_compiler and build_problems.
 
   RUN
-    ./regex2mindfa input.txt out.dfa
+    ./regex2mindfa [--stats] [--binary] [--glushkov] [--no-simplify] [--threads N] [budgets] input.txt out.dfa
+    ./regex2mindfa [--stats] [--binary] [--glushkov] [--no-simplify] [--threads N] [budgets] --serve
+    ./regex2mindfa [--stats] [--glushkov] [--no-simplify] [--no-bitparallel] [budgets] --check input.txt ref.dfa tests.txt
+    ./regex2mindfa [--stats] [--glushkov] [--no-simplify] [--no-bitparallel] [budgets] --check --serve
+
+    --stats     print a STATS line to stderr (see STATS below)
+    --binary    write the binary .dfa format (also for --serve responses)
+    --glushkov  build the epsilon-free position automaton (one NFA state per symbol
+                occurrence) instead of the Thompson NFA; the minimized output is identical
+    --no-simplify  build the automaton from the regex as written, skipping the
+                algebraic simplification (see "regex simplification"); the output is
+                the same
+    --threads   run the subset construction on N threads (at most 64); the output is
+                byte-identical to the single-threaded one, only large DFAs gain from it
+    --check     grade the regex on a tests file (dfa_checker's format, output and exit
+                codes) against ref.dfa, building DFA states lazily in a bounded cache
+                instead of writing the minimized DFA; a regex with fewer than 64
+                positions runs as a bit-parallel Glushkov automaton instead
+                (--no-bitparallel: always the lazy DFA)
+    --serve   long-running grader mode; requests are read from stdin until EOF
+    budgets   --max-nfa-states N, --max-dfa-states N, --max-bytes N, --max-steps N:
+              stop a compilation that grows past any of them with a BUDGET line and
+              exit code 124 (see "budgets" below); each --serve request gets the full
+              budgets. --check also spends --max-steps on its tests and stops with
+              "Error: step budget exceeded" and exit code 124 when they run out. In the
+              Node addon the steps come from the call instead.
+
+    Inputs may be - (stdin) or /dev/fd/N and out.dfa may be - (stdout), so the tool
+    runs in a pipeline without files.
+
+  STATS
+    With --stats a successful run ends its stderr with one line
+      STATS {"tool":"regex2mindfa","nfa":"thompson"|"glushkov","parse_ms":..,"nfa_ms":..,"dfa_ms":..,"min_ms":..,"write_ms":..,
+             "total_ms":..,"nfa_states":..,"dfa_states":..,"min_states":..,"hopcroft_pops":..,
+             "hopcroft_splits":..,"hash_lookups":..,"hash_probes":..}
+    dfa_states is the subset construction before minimization, min_states after it.
+    --check prints instead
+      STATS {"tool":"regex2mindfa","mode":"check","nfa":..,"sim":"lazy"|"bitparallel","parse_ms":..,
+             "nfa_ms":..,"check_ms":..,"total_ms":..,"nfa_states":..,"lazy_states":..,"lazy_flushes":..,
+             "tests":..,"bytes":..}
+    lazy_states counts every DFA state built, including those built again after a flush.
+    A compilation stopped by a budget prints a BUDGET line instead, with or without
+    --stats (see "budgets").
+
+  SERVE PROTOCOL (one request at a time, fields are raw bytes)
+    request : "<len>\n" followed by <len> bytes of input file contents
+    response: "<exit_code> <stdout_len> <stderr_len>\n" followed by the
+              stdout bytes (the .dfa text) and the stderr bytes
+
+    With --check the request is "<input_len> <ref_len> <tests_len>\n" followed by the
+    input file, the reference .dfa and the tests file contents, and the response
+    carries what --check would have printed.
 */
 
+#define _POSIX_C_SOURCE 200809L /* strdup, clock_gettime */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <setjmp.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "automata.h"
+#include "regex2mindfa.h"
 
 #define EPS_TOK 1              /* internal single-byte epsilon token */
-#define MAX_NFA_STATES 4096
-#define MAX_DFA_STATES 4096
 #define MAX_ALPHABET   128
 
-static void die(const char* msg) { fprintf(stderr, "Error: %s\n", msg); exit(1); }
-static void* xmalloc(size_t n){ void* p=malloc(n); if(!p) die("out of memory"); return p; }
-static void* xcalloc(size_t n,size_t s){ void* p=calloc(n,s); if(!p) die("out of memory"); return p; }
-static void* xrealloc(void* p,size_t n){ void* q=realloc(p,n); if(!q) die("out of memory"); return q; }
+/* ===== compiler state =====
+   A Compiler (regex2mindfa.h) holds everything one compilation works on: the options,
+   the input, each stage's automaton and the memory they live in. Every stage takes it
+   as its first argument C and nothing of a compilation is kept at file scope, so
+   different Compilers compile at the same time and a Compiler can move from thread to
+   thread between compilations. The types are described with the stages that use them. */
+
+typedef struct ArenaChunk { struct ArenaChunk* next; size_t used, cap; uint64_t w[]; } ArenaChunk; /* in words */
+typedef struct {
+    ArenaChunk* head;        /* chunk being bumped, older ones behind it */
+    ArenaChunk* spare;       /* chunks freed by arena_rewind, reused before malloc */
+    size_t words;            /* capacity of all chunks */
+    size_t live;             /* words handed out since the last reset */
+} Arena;
+typedef struct { ArenaChunk* chunk; size_t used, live; } ArenaMark;
+/* A growable array kept across compilations; cap in bytes. */
+typedef struct { void* p; size_t cap; } Retained;
+
+typedef struct { uint64_t* w; int nwords; } Bitset;
+
+typedef struct {
+    char op;                 /* alphabet symbol, EPS_TOK, '.', '|' or '*' */
+    char nullable;
+    char norm;               /* '|' only: flattened and deduplicated */
+    int a, b;                /* operands, -1 when absent */
+} RxNode;
+
+typedef struct { int to; char sym; } Edge; /* sym==0 => epsilon */
+typedef struct { Edge edges[2]; int n_edges; } NFAState;
+
+typedef struct { Bitset first, last; int nullable; } GFrag;
+typedef struct { GFrag* a; int top, cap; } GFragStack;
+
+typedef struct {
+    Bitset set;              /* words live in set_arena */
+    uint64_t hash;           /* bs_hash(&set), cached for the state table */
+    int is_accept;
+} DFAState;
+
+typedef struct { long nfa_states, dfa_states, bytes, steps; } Budgets;
+
+enum { STAGE_PARSE, STAGE_NFA, STAGE_DFA, STAGE_MIN, STAGE_WRITE, STAGE_COUNT };
+
+struct Compiler {
+    /* die() reports into err_out (stderr when NULL) and unwinds to die_jmp when set */
+    FILE* err_out;
+    jmp_buf* die_jmp;
+    int budget_hit;          /* the die() was a budget overrun (see "budgets") */
+    Compiler* next_idle;     /* regex2mindfa_call's idle Compilers */
+
+    /* options */
+    int write_binary;        /* --binary: write the automata.h binary format instead of text */
+    int use_simplify, use_glushkov, use_bitparallel;
+    int n_threads;
+    Budgets budgets;
+
+    /* compilation memory */
+    Arena work_arena, set_arena;
+    Retained dfa_mem, dfa_trans_mem;
+    Retained hash_mem, hash_spare; /* dfa_hash's buffer, the previous one while growing */
+
+    /* input; the regex buffers live in work_arena */
+    char alphabet[MAX_ALPHABET];
+    int  alphabet_size;
+    char *rx_pre, *rx_cat, *rx_post;
+
+    /* regex simplification */
+    RxNode* rx_nodes;
+    int rx_n, rx_cap;
+    int* rx_table;           /* hash-consing table of node ids, -1 => empty */
+    unsigned rx_table_mask;
+    int* rx_seen;            /* per node: stamp of the last walk that visited it */
+    int rx_stamp;
+    jmp_buf* rx_bail;        /* out of nodes: keep the regex as it is */
+
+    /* NFA (Thompson, or Glushkov when nfa_glushkov) */
+    NFAState* nfa;
+    int nfa_states, nfa_cap;
+    Bitset nfa_accept_set;
+    int nfa_glushkov;        /* the NFA of the current compilation is the position automaton */
+
+    /* NFA preprocessing */
+    int  sym_index[256];
+    int* sym_off;
+    int* sym_to;
+    int* eps_off;
+    int* eps_to;
+    uint64_t* clos;
+    unsigned char* clos_done;
+    int* work;               /* reused DFS stack, nfa_states entries */
+    int clos_nwords;
+    uint64_t* clos_key;
+
+    /* Glushkov position automaton */
+    GFragStack gfrag_st;     /* slots keep their Bitsets for the next push */
+    uint64_t* g_follow;
+    uint64_t* g_mask;        /* alphabet_size rows of positions labelled alphabet[a] */
+    int g_nwords;
+
+    /* symbol classes */
+    int n_classes;
+    unsigned char sym_class[MAX_ALPHABET]; /* alphabet index -> column */
+    int class_sym[MAX_ALPHABET];           /* column -> alphabet index stepped for it */
+
+    /* subset construction: dfa[0..dfa_n) grows on demand; the transitions of state s are
+       dfa_trans[s*n_classes .. s*n_classes+n_classes), one per symbol class, -1 => none */
+    DFAState* dfa;
+    int* dfa_trans;
+    int dfa_n, dfa_cap;
+    int* dfa_hash;           /* -1 => empty slot */
+    unsigned dfa_hash_cap;   /* power of two, load factor <= 1/2 */
+    int dfa_hash_miss;       /* empty slot the last missed lookup ended on, or -1 */
+    uint64_t dfa_miss_hash;
+    long hash_lookups, hash_probes;
+    int dfa_budget_on;       /* set while nfa_to_dfa runs; --check keeps its own cache bound */
+    double compile_t0;
+
+    /* minimization; the result, min_cls/min_n/min_need_dead/min_dead, is what write_min_dfa writes */
+    DfaMinStats min_stats;
+    int min_classes;
+    unsigned char min_sym_class[MAX_ALPHABET]; /* alphabet index -> min column */
+    int min_col[MAX_ALPHABET];                 /* min column -> dfa_trans column */
+    int* min_cls;
+    int min_n, min_need_dead, min_dead;
+
+    /* wall time of each pipeline stage in the last compile_input / write_min_dfa call */
+    double stage_ms[STAGE_COUNT];
+
+    /* --check; check_ref and check_reader are released by compiler_reset */
+    DfaTable check_ref;
+    TestReader check_reader;
+    Bitset lz_mv, lz_cl, lz_keep, lz_start;
+    int lz_cap, lz_start_id;
+    long lazy_built, lazy_flushes, tests_run, check_bytes;
+    int bp_on;                     /* the tests run through bp_run */
+    uint64_t (*bp_follow)[256];    /* (nfa_states+7)/8 rows */
+    uint64_t bp_accept;
+};
+
+static FILE* errs(Compiler* C){ return C->err_out ? C->err_out : stderr; }
+static void die(Compiler* C,const char* msg) {
+    fprintf(errs(C), "Error: %s\n", msg);
+#ifdef GRADER_LIBRARY
+    longjmp(*C->die_jmp, 1); /* every entry point sets it */
+#else
+    if(C->die_jmp) longjmp(*C->die_jmp, 1);
+    exit(C->budget_hit ? STEPS_EXCEEDED_EXIT : 1);
+#endif
+}
+static void* xmalloc(Compiler* C,size_t n){ void* p=malloc(n); if(!p) die(C,"out of memory"); return p; }
+static void* xrealloc(Compiler* C,void* p,size_t n){ void* q=realloc(p,n); if(!q) die(C,"out of memory"); return q; }
+
+static double now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec*1e3 + (double)ts.tv_nsec/1e6;
+}
 
 static int is_meta(char c){ return (c=='|'||c=='+'||c=='*'||c=='('||c==')'||c=='.'); }
 
-/* ===== alphabet (runtime) ===== */
-static char ALPHABET[MAX_ALPHABET];
-static int  ALPHABET_SIZE = 0;
+/* ===== compilation memory =====
+   A compilation allocates from two bump arenas instead of malloc: set_arena holds the
+   DFA state sets (--check empties it on its own when its cache is flushed) and
+   work_arena everything else whose size is known up front: the regex buffers, NFA
+   states, Bitsets, NFA tables and the minimization and writer arrays. The arrays that
+   grow while DFA states are discovered (dfa[], dfa_trans[], the state table) are
+   Retained buffers. compiler_reset() rewinds all of them without freeing: an arena
+   that needed several chunks is coalesced into one, so compiling regexes of similar
+   size back to back (--serve, the addon, bench_compiler) does no malloc or free once
+   warm. Memory past ARENA_KEEP_BYTES is released instead, so one huge regex does not
+   pin it. The arenas and buffers belong to the Compiler, one per caller in the addon. */
+#define ARENA_KEEP_BYTES ((size_t)32<<20)
+
+/* Chunks double from 8 KB up to 8 MB, so small regexes touch a few pages only. */
+static uint64_t* arena_words(Compiler* C,Arena* a,size_t n){
+    ArenaChunk* c=a->head;
+    if(!c || c->cap - c->used < n){
+        if(a->spare && a->spare->cap >= n){
+            c=a->spare;
+            a->spare=c->next;
+        } else {
+            size_t cap = c ? c->cap*2 : 1024;
+            if(cap > ((size_t)1<<20)) cap = (size_t)1<<20;
+            if(cap < n) cap = n;
+            c=(ArenaChunk*)xmalloc(C,sizeof(ArenaChunk)+cap*sizeof(uint64_t));
+            c->cap=cap;
+            a->words+=cap;
+        }
+        c->next=a->head; c->used=0;
+        a->head=c;
+    }
+    uint64_t* p=c->w+c->used;
+    c->used+=n;
+    a->live+=n;
+    return p;
+}
+static void* arena_alloc(Compiler* C,Arena* a,size_t bytes){ return arena_words(C,a,(bytes+7)/8); }
+static void* arena_zalloc(Compiler* C,Arena* a,size_t bytes){
+    void* p=arena_alloc(C,a,bytes);
+    memset(p,0,bytes);
+    return p;
+}
 
-static int is_alphabet_symbol(char c){
-    for(int i=0;i<ALPHABET_SIZE;i++) if(ALPHABET[i]==c) return 1;
+static ArenaMark arena_mark(const Arena* a){
+    return (ArenaMark){ a->head, a->head ? a->head->used : 0, a->live };
+}
+/* Drops everything allocated since m; chunks started since then become spares. */
+static void arena_rewind(Arena* a,ArenaMark m){
+    while(a->head!=m.chunk){
+        ArenaChunk* c=a->head;
+        a->head=c->next;
+        c->next=a->spare;
+        a->spare=c;
+    }
+    if(a->head) a->head->used=m.used;
+    a->live=m.live;
+}
+
+static void arena_release(Arena* a){
+    ArenaChunk* lists[2]={ a->head, a->spare };
+    for(int i=0;i<2;i++) while(lists[i]){ ArenaChunk* n=lists[i]->next; free(lists[i]); lists[i]=n; }
+    a->head=a->spare=NULL;
+    a->words=a->live=0;
+}
+
+/* Empties a, keeping its capacity as a single chunk. */
+static void arena_reset(Arena* a){
+    size_t words=a->words;
+    a->live=0;
+    if(words*sizeof(uint64_t) > ARENA_KEEP_BYTES){ arena_release(a); return; }
+    if(a->spare || (a->head && a->head->next)){
+        arena_release(a);
+        ArenaChunk* c=(ArenaChunk*)malloc(sizeof(ArenaChunk)+words*sizeof(uint64_t));
+        if(!c) return;
+        c->next=NULL; c->cap=words;
+        a->head=c;
+        a->words=words;
+    }
+    if(a->head) a->head->used=0;
+}
+
+static void* retained_reserve(Compiler* C,Retained* r,size_t bytes){
+    if(bytes > r->cap){
+        size_t cap = r->cap ? r->cap : 4096;
+        while(cap < bytes) cap*=2;
+        r->p=xrealloc(C,r->p,cap);
+        r->cap=cap;
+    }
+    return r->p;
+}
+static void retained_trim(Retained* r,size_t keep){
+    if(r->cap > keep){ free(r->p); r->p=NULL; r->cap=0; }
+}
+
+/* ===== alphabet (runtime) ===== */
+static int is_alphabet_symbol(Compiler* C,char c){
+    for(int i=0;i<C->alphabet_size;i++) if(C->alphabet[i]==c) return 1;
     return 0;
 }
 
-static void parse_alphabet_line(const char* line){
+static void parse_alphabet_line(Compiler* C,const char* line){
     int seen[256]={0};
-    ALPHABET_SIZE=0;
+    C->alphabet_size=0;
 
     for(size_t i=0; line[i]; i++){
         unsigned char uc=(unsigned char)line[i];
@@ -81,24 +386,24 @@ static void parse_alphabet_line(const char* line){
         if(c=='\n'||c=='\r') continue;
         if(isspace(uc)||c==','||c==';') continue;
 
-        if((unsigned char)c == EPS_TOK) die("alphabet must not contain internal epsilon token");
-        if(is_meta(c)) die("alphabet contains meta-operator (| + * ( ) .)");
+        if((unsigned char)c == EPS_TOK) die(C,"alphabet must not contain internal epsilon token");
+        if(is_meta(c)) die(C,"alphabet contains meta-operator (| + * ( ) .)");
         // disallow non-ASCII control bytes (for safety)
-        if(uc < 32) die("alphabet contains non-printable byte");
-        if(seen[uc]) die("alphabet contains duplicate symbol");
-        if(ALPHABET_SIZE>=MAX_ALPHABET) die("alphabet too large");
+        if(uc < 32) die(C,"alphabet contains non-printable byte");
+        if(seen[uc]) die(C,"alphabet contains duplicate symbol");
+        if(C->alphabet_size>=MAX_ALPHABET) die(C,"alphabet too large");
 
         seen[uc]=1;
-        ALPHABET[ALPHABET_SIZE++]=c;
+        C->alphabet[C->alphabet_size++]=c;
     }
-    if(ALPHABET_SIZE==0) die("alphabet is empty");
+    if(C->alphabet_size==0) die(C,"alphabet is empty");
 }
 
 /* ===== regex preprocessing: UTF-8 'ε' and <eps> -> EPS_TOK, then strip spaces ===== */
-static char* preprocess_regex(const char* line){
+static char* preprocess_regex(Compiler* C,const char* line){
     size_t n = strlen(line);
     // output won't exceed input length (we may shrink)
-    char* out = (char*)xmalloc(n + 1);
+    char* out = (char*)arena_alloc(C,&C->work_arena,n + 1);
     size_t j = 0;
 
     for(size_t i=0;i<n;){
@@ -128,51 +433,51 @@ static char* preprocess_regex(const char* line){
     return out;
 }
 
-static void check_parentheses_balanced(const char* s){
+static void check_parentheses_balanced(Compiler* C,const char* s){
     int bal=0;
     for(size_t i=0;s[i];i++){
         if(s[i]=='(') bal++;
         else if(s[i]==')') bal--;
-        if(bal<0) die("mismatched parentheses: extra ')'");
+        if(bal<0) die(C,"mismatched parentheses: extra ')'");
     }
-    if(bal!=0) die("mismatched parentheses: unclosed '('");
+    if(bal!=0) die(C,"mismatched parentheses: unclosed '('");
 }
 
-static void check_regex_symbols_valid(const char* s){
+static void check_regex_symbols_valid(Compiler* C,const char* s){
     for(size_t i=0;s[i];i++){
         unsigned char uc = (unsigned char)s[i];
         char c=s[i];
 
         if(c==(char)EPS_TOK) continue;
-        if(is_alphabet_symbol(c)) continue;
+        if(is_alphabet_symbol(C,c)) continue;
         if(c=='|'||c=='+'||c=='*'||c=='('||c==')') continue;
-        if(c=='.') die("regex must not contain explicit '.'");
+        if(c=='.') die(C,"regex must not contain explicit '.'");
         // If any leftover UTF-8 bytes show up, report clearly
         if(uc >= 128){
-            die("regex contains non-ASCII byte. Use UTF-8 'ε' or <eps> only for epsilon; other symbols must be single-byte.");
+            die(C,"regex contains non-ASCII byte. Use UTF-8 'ε' or <eps> only for epsilon; other symbols must be single-byte.");
         }
         {
             char msg[128];
             snprintf(msg,sizeof(msg),"regex contains invalid character: '%c'",c);
-            die(msg);
+            die(C,msg);
         }
     }
 }
 
-static int is_atom_end(char c){ return is_alphabet_symbol(c)|| (unsigned char)c==EPS_TOK || c==')'||c=='*'; }
-static int is_atom_start(char c){ return is_alphabet_symbol(c)|| (unsigned char)c==EPS_TOK || c=='('; }
-static int need_concat(char a,char b){ return is_atom_end(a)&&is_atom_start(b); }
+static int is_atom_end(Compiler* C,char c){ return is_alphabet_symbol(C,c)|| (unsigned char)c==EPS_TOK || c==')'||c=='*'; }
+static int is_atom_start(Compiler* C,char c){ return is_alphabet_symbol(C,c)|| (unsigned char)c==EPS_TOK || c=='('; }
+static int need_concat(Compiler* C,char a,char b){ return is_atom_end(C,a)&&is_atom_start(C,b); }
 
-static char* add_concat_ops(const char* in){
+static char* add_concat_ops(Compiler* C,const char* in){
     size_t n=strlen(in);
-    char* out=(char*)xmalloc(2*n+2);
+    char* out=(char*)arena_alloc(C,&C->work_arena,2*n+2);
     size_t j=0;
     for(size_t i=0;i<n;i++){
         char a=in[i];
         out[j++]=a;
         if(i+1<n){
             char b=in[i+1];
-            if(need_concat(a,b)) out[j++]='.';
+            if(need_concat(C,a,b)) out[j++]='.';
         }
     }
     out[j]='\0';
@@ -187,22 +492,22 @@ static int prec(char op){
 }
 static int is_left_assoc(char op){ return op!='*'; }
 
-static char* to_postfix(const char* regex){
+static char* to_postfix(Compiler* C,const char* regex){
     size_t n=strlen(regex);
-    char* out=(char*)xmalloc(2*n+2);
-    char* st =(char*)xmalloc(2*n+2);
+    char* out=(char*)arena_alloc(C,&C->work_arena,2*n+2);
+    char* st =(char*)arena_alloc(C,&C->work_arena,2*n+2);
     int top=-1;
     size_t j=0;
 
     for(size_t i=0;i<n;i++){
         char c=regex[i];
-        if(is_alphabet_symbol(c) || (unsigned char)c==EPS_TOK){
+        if(is_alphabet_symbol(C,c) || (unsigned char)c==EPS_TOK){
             out[j++]=c;
         } else if(c=='('){
             st[++top]=c;
         } else if(c==')'){
             while(top>=0 && st[top]!='(') out[j++]=st[top--];
-            if(top<0) die("mismatched parentheses");
+            if(top<0) die(C,"mismatched parentheses");
             top--;
         } else if(c=='*'){
             out[j++]=c;
@@ -216,453 +521,1546 @@ static char* to_postfix(const char* regex){
             }
             st[++top]=c;
         } else {
-            die("unknown character during postfix conversion");
+            die(C,"unknown character during postfix conversion");
         }
     }
     while(top>=0){
-        if(st[top]=='(') die("mismatched parentheses");
+        if(st[top]=='(') die(C,"mismatched parentheses");
         out[j++]=st[top--];
     }
     out[j]='\0';
-    free(st);
     return out;
 }
 
-/* ===== Thompson epsilon-NFA ===== */
-typedef struct { int to; char sym; } Edge; /* sym==0 => epsilon */
-typedef struct { Edge* edges; int n_edges, cap_edges; } NFAState;
+/* ===== regex simplification =====
+   Rewrites the postfix regex before any automaton is built, so student regexes such
+   as (a*)*, (a|a|b)*, ((ε))a or (a*b*)* do not bloat the NFA and the subset
+   construction. The postfix is read into an expression tree whose nodes are
+   hash-consed (equal subterms are one node, so equality is an id comparison), built
+   bottom-up through constructors that apply, with N(x) meaning x accepts ε:
+     x** -> x*        ε* -> ε        εx -> xε -> x
+     a union is flattened and its duplicate operands dropped once it is complete (it
+       becomes an operand of something else), and ε is dropped from a union that has
+       another nullable operand
+     (...)* body, where only its iterations matter:  (x*|y)* -> (x|y)*,  (ε|x)* -> x*,
+       (xy)* -> (x|y)* when N(x) and N(y)  (so (x*y*)* -> (x|y)*)
+   Every rule preserves the language and none makes the postfix longer; the result is
+   written back as postfix for postfix_to_nfa / postfix_to_glushkov. Malformed postfix
+   is reported with their messages. A regex whose tree outgrows RX_NODES_PER_BYTE nodes
+   per postfix byte (unions rebuilt under many nested stars) is left as it is.
+   --no-simplify skips the pass. */
+#define RX_NODES_PER_BYTE 4
+
+static int rx_node(Compiler* C,char op,int a,int b){
+    uint64_t h=((uint64_t)(unsigned char)op<<42) ^ ((uint64_t)(unsigned)a<<21) ^ (uint64_t)(unsigned)b;
+    h*=0x9E3779B97F4A7C15ULL;
+    unsigned i=(unsigned)(h>>32) & C->rx_table_mask;
+    for(;;){
+        int id=C->rx_table[i];
+        if(id<0) break;
+        if(C->rx_nodes[id].op==op && C->rx_nodes[id].a==a && C->rx_nodes[id].b==b) return id;
+        i=(i+1)&C->rx_table_mask;
+    }
+    if(C->rx_n==C->rx_cap) longjmp(*C->rx_bail,1);
+    RxNode* nd=&C->rx_nodes[C->rx_n];
+    nd->op=op; nd->a=a; nd->b=b; nd->norm=0;
+    if(op==(char)EPS_TOK || op=='*') nd->nullable=1;
+    else if(op=='.') nd->nullable=C->rx_nodes[a].nullable && C->rx_nodes[b].nullable;
+    else if(op=='|') nd->nullable=C->rx_nodes[a].nullable || C->rx_nodes[b].nullable;
+    else nd->nullable=0;
+    C->rx_table[i]=C->rx_n;
+    return C->rx_n++;
+}
+
+static int rx_eps(Compiler* C){ return rx_node(C,(char)EPS_TOK,-1,-1); }
+
+/* Operands collected for a union, in work_arena */
+typedef struct { int* a; int n; } RxList;
+
+static void rx_list_begin(Compiler* C,RxList* l){
+    l->a=(int*)arena_alloc(C,&C->work_arena,(size_t)C->rx_cap*sizeof(int));
+    l->n=0;
+    C->rx_stamp++;
+}
 
-static NFAState nfa[MAX_NFA_STATES];
-static int nfa_states=0;
+/* Adds the operands of the union x (or x itself); star_body also strips what only
+   matters once x is iterated: ε, stars, and nullable concatenations. */
+static void rx_list_add(Compiler* C,RxList* l,int x,int star_body){
+    if(C->rx_seen[x]==C->rx_stamp) return;
+    C->rx_seen[x]=C->rx_stamp;
+    const RxNode* nd=&C->rx_nodes[x];
+    if(star_body && nd->op==(char)EPS_TOK) return;
+    if(nd->op=='|' || (star_body && (nd->op=='*' || (nd->op=='.' && nd->nullable)))){
+        rx_list_add(C,l,nd->a,star_body);
+        if(nd->b>=0) rx_list_add(C,l,nd->b,star_body);
+        return;
+    }
+    l->a[l->n++]=x;
+}
 
-static int new_nfa_state(void){
-    if(nfa_states>=MAX_NFA_STATES) die("too many NFA states");
-    nfa[nfa_states].edges=NULL;
-    nfa[nfa_states].n_edges=0;
-    nfa[nfa_states].cap_edges=0;
-    return nfa_states++;
+/* The union of l's operands; -1 when l is empty. */
+static int rx_list_union(Compiler* C,const RxList* l){
+    int has_nullable=0, eps=rx_eps(C);
+    for(int i=0;i<l->n;i++) if(l->a[i]!=eps && C->rx_nodes[l->a[i]].nullable) has_nullable=1;
+    int r=-1;
+    for(int i=0;i<l->n;i++){
+        int x=l->a[i];
+        if(x==eps && has_nullable) continue;
+        if(r<0){ r=x; continue; }
+        r=rx_node(C,'|',r,x);
+        C->rx_nodes[r].norm=1;
+    }
+    return r;
 }
-static void add_edge(int from,int to,char sym){
-    NFAState* s=&nfa[from];
-    if(s->n_edges==s->cap_edges){
-        s->cap_edges = s->cap_edges ? s->cap_edges*2 : 4;
-        s->edges=(Edge*)xrealloc(s->edges,(size_t)s->cap_edges*sizeof(Edge));
+
+/* A complete union, flattened and deduplicated; other nodes unchanged. */
+static int rx_done(Compiler* C,int x){
+    if(C->rx_nodes[x].op!='|' || C->rx_nodes[x].norm) return x;
+    ArenaMark m=arena_mark(&C->work_arena);
+    RxList l;
+    rx_list_begin(C,&l);
+    rx_list_add(C,&l,x,0);
+    int r=rx_list_union(C,&l);
+    arena_rewind(&C->work_arena,m);
+    return r;
+}
+
+static int rx_concat(Compiler* C,int x,int y){
+    x=rx_done(C,x);
+    y=rx_done(C,y);
+    if(C->rx_nodes[x].op==(char)EPS_TOK) return y;
+    if(C->rx_nodes[y].op==(char)EPS_TOK) return x;
+    return rx_node(C,'.',x,y);
+}
+
+static int rx_star(Compiler* C,int x){
+    ArenaMark m=arena_mark(&C->work_arena);
+    RxList l;
+    rx_list_begin(C,&l);
+    rx_list_add(C,&l,x,1);
+    int body=rx_list_union(C,&l);
+    arena_rewind(&C->work_arena,m);
+    return body<0 ? rx_eps(C) : rx_node(C,'*',body,-1);
+}
+
+/* Writes x as postfix into out .. end; NULL when it does not fit. */
+static char* rx_emit(Compiler* C,char* out,const char* end,int x){
+    const RxNode* nd=&C->rx_nodes[x];
+    if(nd->a>=0 && !(out=rx_emit(C,out,end,nd->a))) return NULL;
+    if(nd->b>=0 && !(out=rx_emit(C,out,end,nd->b))) return NULL;
+    if(out==end) return NULL;
+    *out++=nd->op;
+    return out;
+}
+
+/* Simplifies post in place. */
+static void simplify_postfix(Compiler* C,char* post){
+    size_t n=strlen(post);
+    ArenaMark m=arena_mark(&C->work_arena);
+    jmp_buf jb;
+    if(setjmp(jb)!=0){
+        C->rx_bail=NULL;
+        arena_rewind(&C->work_arena,m);
+        return;
+    }
+    C->rx_bail=&jb;
+
+    C->rx_cap=(int)(RX_NODES_PER_BYTE*n+64);
+    C->rx_n=0;
+    C->rx_nodes=(RxNode*)arena_alloc(C,&C->work_arena,(size_t)C->rx_cap*sizeof(RxNode));
+    C->rx_seen=(int*)arena_zalloc(C,&C->work_arena,(size_t)C->rx_cap*sizeof(int));
+    C->rx_stamp=0;
+    unsigned tcap=64;
+    while(tcap < 2*(unsigned)C->rx_cap) tcap*=2;
+    C->rx_table_mask=tcap-1;
+    C->rx_table=(int*)arena_alloc(C,&C->work_arena,(size_t)tcap*sizeof(int));
+    for(unsigned i=0;i<tcap;i++) C->rx_table[i]=-1;
+
+    int* st=(int*)arena_alloc(C,&C->work_arena,(n+1)*sizeof(int));
+    int top=0;
+    for(size_t i=0;i<n;i++){
+        char c=post[i];
+        if(is_alphabet_symbol(C,c) || (unsigned char)c==EPS_TOK){
+            st[top++]=rx_node(C,c,-1,-1);
+        } else if(c=='.' || c=='|' || c=='+'){
+            if(top<2){ C->rx_bail=NULL; die(C,"invalid postfix (stack underflow)"); }
+            int y=st[--top], x=st[--top];
+            st[top++] = c=='.' ? rx_concat(C,x,y) : rx_node(C,'|',x,y);
+        } else if(c=='*'){
+            if(top<1){ C->rx_bail=NULL; die(C,"invalid postfix (stack underflow)"); }
+            st[top-1]=rx_star(C,st[top-1]);
+        } else {
+            C->rx_bail=NULL;
+            die(C,"invalid postfix token");
+        }
     }
+    if(top!=1){ C->rx_bail=NULL; die(C,"invalid postfix (stack not singleton)"); }
+    int root=rx_done(C,st[0]);
+
+    /* copied over post, which it never outgrows */
+    char* out=(char*)arena_alloc(C,&C->work_arena,n);
+    char* end=rx_emit(C,out,out+n,root);
+    C->rx_bail=NULL;
+    if(!end) longjmp(jb,1);
+    memcpy(post,out,(size_t)(end-out));
+    post[end-out]='\0';
+    arena_rewind(&C->work_arena,m);
+    return;
+}
+
+/* ===== Thompson epsilon-NFA ===== */
+/* Every postfix token makes at most two states, and a state gets its out-edges either
+   when it is made or when the fragment it accepts is combined, never more than two;
+   so nfa[] is sized from the postfix length and the edges are stored inline. */
+
+static void nfa_reserve(Compiler* C,size_t post_len){
+    C->nfa_cap=(int)(2*post_len+1);
+    C->nfa=(NFAState*)arena_alloc(C,&C->work_arena,(size_t)C->nfa_cap*sizeof(NFAState));
+    C->nfa_states=0;
+}
+static int new_nfa_state(Compiler* C){
+    if(C->nfa_states==C->nfa_cap) die(C,"internal error: NFA state bound exceeded");
+    C->nfa[C->nfa_states].n_edges=0;
+    return C->nfa_states++;
+}
+static void add_edge(Compiler* C,int from,int to,char sym){
+    NFAState* s=&C->nfa[from];
+    if(s->n_edges==2) die(C,"internal error: NFA state has more than two edges");
     s->edges[s->n_edges++] = (Edge){to,sym};
 }
 
 typedef struct { int start, accept; } Frag;
 typedef struct { Frag* a; int top, cap; } FragStack;
 
-static void fs_init(FragStack* fs){ fs->a=NULL; fs->top=0; fs->cap=0; }
-static void fs_push(FragStack* fs, Frag f){
-    if(fs->top==fs->cap){
-        fs->cap = fs->cap ? fs->cap*2 : 16;
-        fs->a=(Frag*)xrealloc(fs->a,(size_t)fs->cap*sizeof(Frag));
-    }
+static void fs_push(Compiler* C,FragStack* fs, Frag f){
+    if(fs->top==fs->cap) die(C,"invalid postfix (stack overflow)");
     fs->a[fs->top++]=f;
 }
-static Frag fs_pop(FragStack* fs){
-    if(fs->top<=0) die("invalid postfix (stack underflow)");
+static Frag fs_pop(Compiler* C,FragStack* fs){
+    if(fs->top<=0) die(C,"invalid postfix (stack underflow)");
     return fs->a[--fs->top];
 }
 
-static Frag postfix_to_nfa(const char* post){
-    FragStack st; fs_init(&st);
+static Frag postfix_to_nfa(Compiler* C,const char* post){
+    FragStack fs={ NULL, 0, (int)strlen(post) };
+    fs.a=(Frag*)arena_alloc(C,&C->work_arena,(size_t)fs.cap*sizeof(Frag));
+    FragStack* st=&fs;
 
     for(size_t i=0; post[i]; i++){
         unsigned char uc = (unsigned char)post[i];
         char c=post[i];
 
-        if(is_alphabet_symbol(c)){
-            int s=new_nfa_state(), t=new_nfa_state();
-            add_edge(s,t,c);
-            fs_push(&st,(Frag){s,t});
+        if(is_alphabet_symbol(C,c)){
+            int s=new_nfa_state(C), t=new_nfa_state(C);
+            add_edge(C,s,t,c);
+            fs_push(C,st,(Frag){s,t});
         } else if(uc==EPS_TOK){
-            int s=new_nfa_state(), t=new_nfa_state();
-            add_edge(s,t,0);
-            fs_push(&st,(Frag){s,t});
+            int s=new_nfa_state(C), t=new_nfa_state(C);
+            add_edge(C,s,t,0);
+            fs_push(C,st,(Frag){s,t});
         } else if(c=='.'){
-            Frag f2=fs_pop(&st), f1=fs_pop(&st);
-            add_edge(f1.accept, f2.start, 0);
-            fs_push(&st,(Frag){f1.start, f2.accept});
+            Frag f2=fs_pop(C,st), f1=fs_pop(C,st);
+            add_edge(C,f1.accept, f2.start, 0);
+            fs_push(C,st,(Frag){f1.start, f2.accept});
         } else if(c=='|'||c=='+'){
-            Frag f2=fs_pop(&st), f1=fs_pop(&st);
-            int s=new_nfa_state(), t=new_nfa_state();
-            add_edge(s,f1.start,0); add_edge(s,f2.start,0);
-            add_edge(f1.accept,t,0); add_edge(f2.accept,t,0);
-            fs_push(&st,(Frag){s,t});
+            Frag f2=fs_pop(C,st), f1=fs_pop(C,st);
+            int s=new_nfa_state(C), t=new_nfa_state(C);
+            add_edge(C,s,f1.start,0); add_edge(C,s,f2.start,0);
+            add_edge(C,f1.accept,t,0); add_edge(C,f2.accept,t,0);
+            fs_push(C,st,(Frag){s,t});
         } else if(c=='*'){
-            Frag f=fs_pop(&st);
-            int s=new_nfa_state(), t=new_nfa_state();
-            add_edge(s,f.start,0); add_edge(s,t,0);
-            add_edge(f.accept,f.start,0); add_edge(f.accept,t,0);
-            fs_push(&st,(Frag){s,t});
+            Frag f=fs_pop(C,st);
+            int s=new_nfa_state(C), t=new_nfa_state(C);
+            add_edge(C,s,f.start,0); add_edge(C,s,t,0);
+            add_edge(C,f.accept,f.start,0); add_edge(C,f.accept,t,0);
+            fs_push(C,st,(Frag){s,t});
         } else {
-            die("invalid postfix token");
+            die(C,"invalid postfix token");
         }
     }
-    if(st.top!=1) die("invalid postfix (stack not singleton)");
-    Frag res=fs_pop(&st);
-    free(st.a);
-    return res;
+    if(st->top!=1) die(C,"invalid postfix (stack not singleton)");
+    return fs_pop(C,st);
 }
 
 /* ===== Bitset ===== */
-typedef struct { uint64_t* w; int nwords; } Bitset;
-
-static Bitset bs_new(int nbits){
+/* Zeroed, in work_arena */
+static Bitset bs_new(Compiler* C,int nbits){
     Bitset b;
     b.nwords=(nbits+63)/64;
-    b.w=(uint64_t*)xcalloc((size_t)b.nwords,sizeof(uint64_t));
+    b.w=(uint64_t*)arena_zalloc(C,&C->work_arena,(size_t)b.nwords*sizeof(uint64_t));
     return b;
 }
-static void bs_free(Bitset* b){ free(b->w); b->w=NULL; b->nwords=0; }
 static void bs_set(Bitset* b,int i){ b->w[i>>6] |= (uint64_t)1 << (i&63); }
-static int  bs_get(const Bitset* b,int i){ return (int)((b->w[i>>6]>>(i&63))&1ULL); }
 static int  bs_eq(const Bitset* a,const Bitset* b){
     for(int i=0;i<a->nwords;i++) if(a->w[i]!=b->w[i]) return 0;
     return 1;
 }
-static int bs_empty(const Bitset* a){
-    for(int i=0;i<a->nwords;i++) if(a->w[i]) return 0;
-    return 1;
+static int  bs_intersects(const Bitset* a,const Bitset* b){
+    for(int i=0;i<a->nwords;i++) if(a->w[i]&b->w[i]) return 1;
+    return 0;
 }
-
-static void eps_closure(Bitset* out,const Bitset* in){
-    for(int i=0;i<out->nwords;i++) out->w[i]=in->w[i];
-    int* q=(int*)xmalloc((size_t)nfa_states*sizeof(int));
-    int qh=0, qt=0;
-    for(int s=0;s<nfa_states;s++) if(bs_get(in,s)) q[qt++]=s;
-    while(qh<qt){
-        int u=q[qh++];
-        NFAState* st=&nfa[u];
-        for(int ei=0;ei<st->n_edges;ei++){
-            Edge e=st->edges[ei];
-            if(e.sym==0 && !bs_get(out,e.to)){
-                bs_set(out,e.to);
-                q[qt++]=e.to;
-            }
-        }
+static void bs_or(Bitset* a,const Bitset* b){
+    for(int i=0;i<a->nwords;i++) a->w[i]|=b->w[i];
+}
+static uint64_t bs_hash(const Bitset* a){
+    /* word-wise multiply/xorshift mix over Bitset.w */
+    uint64_t h=0x9E3779B97F4A7C15ULL;
+    for(int i=0;i<a->nwords;i++){
+        h ^= a->w[i] + 0x9E3779B97F4A7C15ULL + (h<<6) + (h>>2);
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h>>31;
     }
-    free(q);
+    return h;
 }
 
-static void move_on_symbol(Bitset* out,const Bitset* in,char sym){
-    for(int i=0;i<out->nwords;i++) out->w[i]=0;
-    for(int s=0;s<nfa_states;s++) if(bs_get(in,s)){
-        NFAState* st=&nfa[s];
-        for(int ei=0;ei<st->n_edges;ei++){
-            Edge e=st->edges[ei];
-            if(e.sym==sym) bs_set(out,e.to);
-        }
-    }
+/* ===== NFA preprocessing: per-symbol CSR adjacency + memoized epsilon closures =====
+   Built once after postfix_to_nfa. sym_off/sym_to hold, for every (alphabet index a,
+   NFA state s), the targets of s on alphabet[a] at sym_to[sym_off[a*N+s] .. sym_off[a*N+s+1]).
+   eps_off/eps_to are the same for epsilon edges. clos holds the epsilon closure of each
+   NFA state as a row of nwords words, computed on first use, cut down to clos_key: the
+   states with a symbol edge and the accepting state. The states it drops only pass
+   epsilon edges on, so a subset state is known by its key states alone, and symbols
+   that lead to the same place through different occurrences, b and c in (b+c)*, reach
+   the same subset state; their columns then merge in minimize_subset_dfa. */
+
+static void sym_index_build(Compiler* C){
+    for(int c=0;c<256;c++) C->sym_index[c]=-1;
+    for(int a=0;a<C->alphabet_size;a++) C->sym_index[(unsigned char)C->alphabet[a]]=a;
 }
 
-/* ===== DFA construction ===== */
-typedef struct {
-    Bitset set;
-    int is_accept;
-    int trans[MAX_ALPHABET]; /* only [0..ALPHABET_SIZE-1] */
-} DFAState;
+static void nfa_tables_build(Compiler* C,const Bitset* accept){
+    int N=C->nfa_states, K=C->alphabet_size;
+    sym_index_build(C);
+
+    C->sym_off=(int*)arena_zalloc(C,&C->work_arena,((size_t)K*(size_t)N+1)*sizeof(int));
+    C->eps_off=(int*)arena_zalloc(C,&C->work_arena,((size_t)N+1)*sizeof(int));
+    int n_sym=0, n_eps=0;
+    for(int s=0;s<N;s++) for(int ei=0;ei<C->nfa[s].n_edges;ei++){
+        Edge e=C->nfa[s].edges[ei];
+        if(e.sym==0){ C->eps_off[s+1]++; n_eps++; }
+        else { C->sym_off[C->sym_index[(unsigned char)e.sym]*N+s+1]++; n_sym++; }
+    }
+    for(size_t i=0;i<(size_t)K*(size_t)N;i++) C->sym_off[i+1]+=C->sym_off[i];
+    for(int s=0;s<N;s++) C->eps_off[s+1]+=C->eps_off[s];
+
+    C->sym_to=(int*)arena_alloc(C,&C->work_arena,(size_t)(n_sym?n_sym:1)*sizeof(int));
+    C->eps_to=(int*)arena_alloc(C,&C->work_arena,(size_t)(n_eps?n_eps:1)*sizeof(int));
+    ArenaMark m=arena_mark(&C->work_arena);
+    int* fill=(int*)arena_alloc(C,&C->work_arena,((size_t)K*(size_t)N+1)*sizeof(int));
+    int* efill=(int*)arena_alloc(C,&C->work_arena,((size_t)N+1)*sizeof(int));
+    memcpy(fill,C->sym_off,((size_t)K*(size_t)N+1)*sizeof(int));
+    memcpy(efill,C->eps_off,((size_t)N+1)*sizeof(int));
+    for(int s=0;s<N;s++) for(int ei=0;ei<C->nfa[s].n_edges;ei++){
+        Edge e=C->nfa[s].edges[ei];
+        if(e.sym==0) C->eps_to[efill[s]++]=e.to;
+        else C->sym_to[fill[C->sym_index[(unsigned char)e.sym]*N+s]++]=e.to;
+    }
+    arena_rewind(&C->work_arena,m);
+
+    C->clos_nwords=(N+63)/64;
+    C->clos=(uint64_t*)arena_zalloc(C,&C->work_arena,(size_t)N*(size_t)C->clos_nwords*sizeof(uint64_t));
+    C->clos_done=(unsigned char*)arena_zalloc(C,&C->work_arena,(size_t)N);
+    C->work=(int*)arena_alloc(C,&C->work_arena,(size_t)(N?N:1)*sizeof(int));
+    C->clos_key=(uint64_t*)arena_alloc(C,&C->work_arena,(size_t)C->clos_nwords*sizeof(uint64_t));
+    for(int w=0;w<C->clos_nwords;w++) C->clos_key[w]=accept->w[w];
+    for(int s=0;s<N;s++) for(int ei=0;ei<C->nfa[s].n_edges;ei++)
+        if(C->nfa[s].edges[ei].sym!=0) C->clos_key[s>>6] |= (uint64_t)1 << (s&63);
+}
 
-static DFAState dfa[MAX_DFA_STATES];
-static int dfa_n=0;
-
-static int find_dfa_state(const Bitset* s){
-    for(int i=0;i<dfa_n;i++) if(bs_eq(&dfa[i].set,s)) return i;
-    return -1;
-}
-static int dfa_add_state(const Bitset* s,int nfa_accept){
-    if(dfa_n>=MAX_DFA_STATES) die("too many DFA states");
-    dfa[dfa_n].set=bs_new(nfa_states);
-    for(int i=0;i<dfa[dfa_n].set.nwords;i++) dfa[dfa_n].set.w[i]=s->w[i];
-    dfa[dfa_n].is_accept = bs_get(s,nfa_accept);
-    for(int i=0;i<ALPHABET_SIZE;i++) dfa[dfa_n].trans[i]=-1;
-    return dfa_n++;
-}
-
-static void nfa_to_dfa(int nfa_start,int nfa_accept){
-    Bitset init=bs_new(nfa_states);
-    bs_set(&init,nfa_start);
-    Bitset init_cl=bs_new(nfa_states);
-    eps_closure(&init_cl,&init);
-
-    dfa_n=0;
-    dfa_add_state(&init_cl,nfa_accept);
-
-    int* q=(int*)xmalloc((size_t)MAX_DFA_STATES*sizeof(int));
-    int qh=0,qt=0;
-    q[qt++]=0;
-
-    Bitset mv=bs_new(nfa_states);
-    Bitset cl=bs_new(nfa_states);
-
-    while(qh<qt){
-        int id=q[qh++];
-        for(int ai=0;ai<ALPHABET_SIZE;ai++){
-            char sym=ALPHABET[ai];
-            move_on_symbol(&mv,&dfa[id].set,sym);
-            if(bs_empty(&mv)){
-                dfa[id].trans[ai]=-1;
+/* Epsilon closure of a single NFA state restricted to clos_key, memoized. Already-closed
+   states reached during the walk contribute their row instead of being re-expanded. */
+static const uint64_t* state_closure(Compiler* C,int s){
+    uint64_t* row=&C->clos[(size_t)s*(size_t)C->clos_nwords];
+    if(C->clos_done[s]) return row;
+
+    int top=0;
+    row[s>>6] |= (uint64_t)1 << (s&63);
+    C->work[top++]=s;
+    while(top>0){
+        int u=C->work[--top];
+        for(int i=C->eps_off[u];i<C->eps_off[u+1];i++){
+            int t=C->eps_to[i];
+            if((row[t>>6]>>(t&63))&1ULL) continue;
+            if(C->clos_done[t]){
+                const uint64_t* tr=&C->clos[(size_t)t*(size_t)C->clos_nwords];
+                for(int w=0;w<C->clos_nwords;w++) row[w]|=tr[w];
                 continue;
             }
-            eps_closure(&cl,&mv);
-            int ex=find_dfa_state(&cl);
-            if(ex<0){
-                ex=dfa_add_state(&cl,nfa_accept);
-                q[qt++]=ex;
+            row[t>>6] |= (uint64_t)1 << (t&63);
+            C->work[top++]=t;
+        }
+    }
+    for(int w=0;w<C->clos_nwords;w++) row[w]&=C->clos_key[w];
+    C->clos_done[s]=1;
+    return row;
+}
+
+/* out := eps_closure(move(in, alphabet[ai])), as an OR of precomputed closures.
+   mv receives the raw move set; returns 0 if the move is empty. */
+static int dfa_step(Compiler* C,Bitset* out,Bitset* mv,const Bitset* in,int ai){
+    int N=C->nfa_states;
+    const int* off=&C->sym_off[(size_t)ai*(size_t)N];
+    for(int i=0;i<mv->nwords;i++) mv->w[i]=0;
+    int any=0;
+    for(int wi=0;wi<in->nwords;wi++){
+        uint64_t bits=in->w[wi];
+        while(bits){
+            int s=wi*64+__builtin_ctzll(bits);
+            bits&=bits-1;
+            for(int i=off[s];i<off[s+1];i++){
+                bs_set(mv,C->sym_to[i]);
+                any=1;
             }
-            dfa[id].trans[ai]=ex;
         }
     }
+    if(!any) return 0;
 
-    bs_free(&init); bs_free(&init_cl); bs_free(&mv); bs_free(&cl);
-    free(q);
+    for(int i=0;i<out->nwords;i++) out->w[i]=0;
+    for(int wi=0;wi<mv->nwords;wi++){
+        uint64_t bits=mv->w[wi];
+        while(bits){
+            int t=wi*64+__builtin_ctzll(bits);
+            bits&=bits-1;
+            const uint64_t* row=state_closure(C,t);
+            for(int w=0;w<out->nwords;w++) out->w[w]|=row[w];
+        }
+    }
+    return 1;
 }
 
-/* ===== Hopcroft minimization ===== */
-typedef struct { int* a; int n,cap; } IntVec;
-static void iv_init(IntVec* v){ v->a=NULL; v->n=0; v->cap=0; }
-static void iv_push(IntVec* v,int x){
-    if(v->n==v->cap){
-        v->cap=v->cap? v->cap*2 : 16;
-        v->a=(int*)xrealloc(v->a,(size_t)v->cap*sizeof(int));
+/* ===== Glushkov position automaton (--glushkov) =====
+   Epsilon-free alternative to the Thompson NFA, built from the same postfix stream.
+   State 0 is the initial state and state p (1..m) is the p-th alphabet symbol occurrence
+   in the regex. Every edge into p is labelled with that symbol, so
+     move(S, a) = (union of follow(p) for p in S) & g_mask[a]
+   and the union is computed once per DFA state for all symbols; there are no closures.
+   follow is a dense (m+1) x (m+1) bit matrix, row 0 being first(regex): about 2 MB for
+   the 4000-byte regexes the server accepts. Each fragment on the stack carries its
+   nullable flag and its first/last position sets. */
+
+static GFrag* gs_push(Compiler* C,int nbits,int nullable){
+    GFragStack* st=&C->gfrag_st;
+    if(st->top==st->cap) die(C,"invalid postfix (stack overflow)");
+    GFrag* f=&st->a[st->top];
+    if(!f->first.w){
+        f->first=bs_new(C,nbits);
+        f->last=bs_new(C,nbits);
+    } else {
+        memset(f->first.w,0,(size_t)f->first.nwords*sizeof(uint64_t));
+        memset(f->last.w,0,(size_t)f->last.nwords*sizeof(uint64_t));
     }
-    v->a[v->n++]=x;
+    f->nullable=nullable;
+    st->top++;
+    return f;
 }
-static void iv_free(IntVec* v){ free(v->a); v->a=NULL; v->n=v->cap=0; }
 
-static int* dfa_minimize(int* out_min_n,int* out_need_dead,int* out_dead){
-    int need_dead=0;
-    for(int s=0;s<dfa_n;s++) for(int a=0;a<ALPHABET_SIZE;a++) if(dfa[s].trans[a]==-1) need_dead=1;
+/* Operands stay on the stack while they are combined; the '.' case swaps last sets
+   between two slots, so each slot still owns exactly one pair. */
+static GFrag* gs_peek(Compiler* C,int depth){
+    if(C->gfrag_st.top<depth) die(C,"invalid postfix (stack underflow)");
+    return &C->gfrag_st.a[C->gfrag_st.top-depth];
+}
+static void gs_drop(Compiler* C){
+    C->gfrag_st.top--;
+}
 
-    int N=dfa_n+(need_dead?1:0);
-    int dead=need_dead? (N-1) : -1;
+/* follow(p) |= to for every p in from */
+static void follow_add(Compiler* C,const Bitset* from,const Bitset* to){
+    for(int wi=0;wi<from->nwords;wi++){
+        uint64_t bits=from->w[wi];
+        while(bits){
+            int p=wi*64+__builtin_ctzll(bits);
+            bits&=bits-1;
+            uint64_t* row=&C->g_follow[(size_t)p*(size_t)C->g_nwords];
+            for(int w=0;w<C->g_nwords;w++) row[w]|=to->w[w];
+        }
+    }
+}
 
-    *out_need_dead=need_dead;
-    *out_dead=dead;
+static int glushkov_positions(Compiler* C,const char* post){
+    int m=0;
+    for(size_t i=0;post[i];i++) if(is_alphabet_symbol(C,post[i])) m++;
+    return m;
+}
 
-    int* T=(int*)xmalloc((size_t)N*(size_t)ALPHABET_SIZE*sizeof(int));
-    int* A=(int*)xmalloc((size_t)N*sizeof(int));
+/* Builds the position automaton of post; nfa_states becomes m+1 and accept receives
+   last(regex), plus state 0 when the regex accepts the empty word. */
+static void postfix_to_glushkov(Compiler* C,const char* post,Bitset* accept){
+    int nbits=glushkov_positions(C,post)+1;
+    for(int i=0;i<nbits;i++) new_nfa_state(C);
+
+    sym_index_build(C);
+    C->g_nwords=(nbits+63)/64;
+    C->g_follow=(uint64_t*)arena_zalloc(C,&C->work_arena,(size_t)nbits*(size_t)C->g_nwords*sizeof(uint64_t));
+    C->g_mask=(uint64_t*)arena_zalloc(C,&C->work_arena,(size_t)C->alphabet_size*(size_t)C->g_nwords*sizeof(uint64_t));
+    C->gfrag_st.top=0;
+    C->gfrag_st.cap=(int)strlen(post);
+    C->gfrag_st.a=(GFrag*)arena_zalloc(C,&C->work_arena,(size_t)C->gfrag_st.cap*sizeof(GFrag));
+
+    int pos=0;
+    for(size_t i=0; post[i]; i++){
+        unsigned char uc = (unsigned char)post[i];
+        char c=post[i];
 
-    for(int s=0;s<dfa_n;s++){
-        A[s]=dfa[s].is_accept;
-        for(int a=0;a<ALPHABET_SIZE;a++){
-            int t=dfa[s].trans[a];
-            if(t==-1) t=dead;
-            T[s*ALPHABET_SIZE+a]=t;
+        if(is_alphabet_symbol(C,c)){
+            int p=++pos;
+            GFrag* f=gs_push(C,nbits,0);
+            bs_set(&f->first,p);
+            bs_set(&f->last,p);
+            C->g_mask[(size_t)C->sym_index[uc]*(size_t)C->g_nwords+(size_t)(p>>6)] |= (uint64_t)1 << (p&63);
+        } else if(uc==EPS_TOK){
+            gs_push(C,nbits,1);
+        } else if(c=='.'){
+            GFrag *f1=gs_peek(C,2), *f2=gs_peek(C,1);
+            follow_add(C,&f1->last,&f2->first);
+            if(f1->nullable) bs_or(&f1->first,&f2->first);
+            if(f2->nullable) bs_or(&f2->last,&f1->last);
+            Bitset t=f1->last; f1->last=f2->last; f2->last=t;
+            f1->nullable = f1->nullable && f2->nullable;
+            gs_drop(C);
+        } else if(c=='|'||c=='+'){
+            GFrag *f1=gs_peek(C,2), *f2=gs_peek(C,1);
+            bs_or(&f1->first,&f2->first);
+            bs_or(&f1->last,&f2->last);
+            f1->nullable = f1->nullable || f2->nullable;
+            gs_drop(C);
+        } else if(c=='*'){
+            GFrag* f=gs_peek(C,1);
+            follow_add(C,&f->last,&f->first);
+            f->nullable=1;
+        } else {
+            die(C,"invalid postfix token");
         }
     }
-    if(need_dead){
-        A[dead]=0;
-        for(int a=0;a<ALPHABET_SIZE;a++) T[dead*ALPHABET_SIZE+a]=dead;
-    }
+    if(C->gfrag_st.top!=1) die(C,"invalid postfix (stack not singleton)");
+
+    GFrag* root=gs_peek(C,1);
+    memcpy(C->g_follow,root->first.w,(size_t)C->g_nwords*sizeof(uint64_t));
+    *accept=bs_new(C,nbits);
+    bs_or(accept,&root->last);
+    if(root->nullable) bs_set(accept,0);
+    gs_drop(C);
+}
 
-    int* cls=(int*)xmalloc((size_t)N*sizeof(int));
-    int nF=0,nNF=0;
-    for(int s=0;s<N;s++) { if(A[s]) nF++; else nNF++; }
-    if(nF==0 || nNF==0){
-        for(int s=0;s<N;s++) cls[s]=0;
-        *out_min_n=1;
-        free(T); free(A);
-        return cls;
+/* fl := union of follow(p) over p in in; shared by every symbol of the DFA state */
+static void glushkov_follow(Compiler* C,Bitset* fl,const Bitset* in){
+    for(int i=0;i<fl->nwords;i++) fl->w[i]=0;
+    for(int wi=0;wi<in->nwords;wi++){
+        uint64_t bits=in->w[wi];
+        while(bits){
+            int p=wi*64+__builtin_ctzll(bits);
+            bits&=bits-1;
+            const uint64_t* row=&C->g_follow[(size_t)p*(size_t)C->g_nwords];
+            for(int w=0;w<C->g_nwords;w++) fl->w[w]|=row[w];
+        }
     }
+}
 
-    IntVec* P=(IntVec*)xcalloc((size_t)N,sizeof(IntVec));
-    int Pn=0;
+/* out := fl & g_mask[ai]; returns 0 if empty */
+static int glushkov_step(Compiler* C,Bitset* out,const Bitset* fl,int ai){
+    const uint64_t* mask=&C->g_mask[(size_t)ai*(size_t)C->g_nwords];
+    uint64_t any=0;
+    for(int w=0;w<C->g_nwords;w++){ out->w[w]=fl->w[w]&mask[w]; any|=out->w[w]; }
+    return any!=0;
+}
 
-    iv_init(&P[Pn]);
-    for(int s=0;s<N;s++) if(A[s]) iv_push(&P[Pn],s);
-    Pn++;
+/* ===== symbol classes =====
+   Each symbol edge of either NFA comes from one occurrence of the symbol in the regex,
+   so two symbols can only step alike when neither occurs, and then both always lead
+   to the dead state. Those share one class and every other symbol is a class of its
+   own. The subset construction and the --check cache keep one column per class
+   (n_classes columns in dfa_trans) and step each class on its first symbol, so an
+   alphabet symbol the regex never uses costs nothing; minimize_subset_dfa merges the
+   columns further and write_min_dfa expands them back to the alphabet. */
+
+static void symbol_classes_build(Compiler* C,const char* post){
+    unsigned char used[256]={0};
+    for(size_t i=0;post[i];i++) used[(unsigned char)post[i]]=1;
+    int unused=-1;
+    C->n_classes=0;
+    for(int a=0;a<C->alphabet_size;a++){
+        int u=used[(unsigned char)C->alphabet[a]];
+        if(!u && unused>=0){ C->sym_class[a]=(unsigned char)unused; continue; }
+        if(!u) unused=C->n_classes;
+        C->class_sym[C->n_classes]=a;
+        C->sym_class[a]=(unsigned char)C->n_classes++;
+    }
+}
 
-    iv_init(&P[Pn]);
-    for(int s=0;s<N;s++) if(!A[s]) iv_push(&P[Pn],s);
-    Pn++;
+/* ===== DFA state table: open addressing over dfa[] ids, keyed on bs_hash ===== */
+static void dfa_hash_init(Compiler* C,unsigned cap){
+    C->dfa_hash_cap=cap;
+    C->dfa_hash=(int*)retained_reserve(C,&C->hash_mem,(size_t)cap*sizeof(int));
+    for(unsigned i=0;i<cap;i++) C->dfa_hash[i]=-1;
+    C->dfa_hash_miss=-1;
+}
 
-    for(int i=0;i<Pn;i++) for(int k=0;k<P[i].n;k++) cls[P[i].a[k]]=i;
+/* Returns the slot holding s, or the empty slot where s belongs. */
+static int dfa_hash_slot(Compiler* C,const Bitset* s,uint64_t h){
+    unsigned mask=C->dfa_hash_cap-1;
+    unsigned i=(unsigned)h & mask;
+    C->hash_lookups++;
+    for(;;){
+        C->hash_probes++;
+        int id=C->dfa_hash[i];
+        if(id<0) return (int)i;
+        if(C->dfa[id].hash==h && bs_eq(&C->dfa[id].set,s)) return (int)i;
+        i=(i+1)&mask;
+    }
+}
 
-    IntVec W; iv_init(&W);
-    if(P[0].n<=P[1].n) iv_push(&W,0); else iv_push(&W,1);
+/* A miss remembers its slot so that dfa_add_state() can insert there without probing again. */
+static int find_dfa_state(Compiler* C,const Bitset* s,uint64_t h){
+    int slot=dfa_hash_slot(C,s,h);
+    int id=C->dfa_hash[slot];
+    if(id<0){ C->dfa_hash_miss=slot; C->dfa_miss_hash=h; }
+    return id;
+}
 
-    IntVec* inv=(IntVec*)xcalloc((size_t)ALPHABET_SIZE*(size_t)N,sizeof(IntVec));
-    for(int a=0;a<ALPHABET_SIZE;a++) for(int q=0;q<N;q++) iv_init(&inv[a*N+q]);
+/* First empty slot for hash h; only for keys known to be absent, so nothing is compared or counted. */
+static int dfa_hash_empty_slot(const Compiler* C,uint64_t h){
+    unsigned mask=C->dfa_hash_cap-1;
+    unsigned j=(unsigned)h & mask;
+    while(C->dfa_hash[j]>=0) j=(j+1)&mask;
+    return (int)j;
+}
 
-    for(int p=0;p<N;p++){
-        for(int a=0;a<ALPHABET_SIZE;a++){
-            int q=T[p*ALPHABET_SIZE+a];
-            iv_push(&inv[a*N+q],p);
-        }
+static void dfa_hash_grow(Compiler* C){
+    unsigned old_cap=C->dfa_hash_cap;
+    Retained t=C->hash_mem; C->hash_mem=C->hash_spare; C->hash_spare=t;
+    const int* old=(const int*)C->hash_spare.p;
+    dfa_hash_init(C,old_cap*2);
+    for(unsigned i=0;i<old_cap;i++){
+        int id=old[i];
+        if(id<0) continue;
+        C->dfa_hash[dfa_hash_empty_slot(C,C->dfa[id].hash)]=id;
     }
+}
 
-    int* mark=(int*)xmalloc((size_t)N*sizeof(int));
+/* ===== budgets =====
+   --max-nfa-states, --max-dfa-states and --max-bytes (0 = no limit, the default) stop a
+   compilation as soon as it grows past them, and --max-steps bounds its work with the
+   step budget of automata.h. An overrun ends stderr with a line
+     BUDGET {"tool":"regex2mindfa","stage":"nfa"|"dfa"|"min","budget":"nfa_states"|"dfa_states"|"bytes"|"steps",
+             "limit":..,"nfa_states":..,"dfa_states":..,"bytes":..,"elapsed_ms":..}
+   before "Error: budget exceeded at stage <stage>, <n> states", and the exit code is
+   STEPS_EXCEEDED_EXIT. bytes counts the compilation's arena and DFA table memory;
+   dfa_minimize()'s work arrays are counted before it runs. The reference compilations
+   of trusted regexes run without budgets. */
+
+static size_t compile_bytes(Compiler* C){
+    return (C->work_arena.live+C->set_arena.live)*sizeof(uint64_t)
+         + (size_t)C->dfa_cap*(sizeof(DFAState)+(size_t)C->n_classes*sizeof(int))
+         + (size_t)C->dfa_hash_cap*sizeof(int);
+}
 
-    while(W.n>0){
-        int Ablock=W.a[--W.n];
+static void budget_exceeded(Compiler* C,const char* stage,const char* what,long limit,int states){
+    fprintf(errs(C),"BUDGET {\"tool\":\"regex2mindfa\",\"stage\":\"%s\",\"budget\":\"%s\",\"limit\":%ld,"
+            "\"nfa_states\":%d,\"dfa_states\":%d,\"bytes\":%zu,\"elapsed_ms\":%.3f}\n",
+            stage,what,limit,C->nfa_states,C->dfa_n,compile_bytes(C),now_ms()-C->compile_t0);
+    char msg[160];
+    snprintf(msg,sizeof(msg),"budget exceeded at stage %s, %d states (%s limit %ld)",stage,states,what,limit);
+    C->budget_hit=1;
+    die(C,msg);
+}
 
-        for(int a=0;a<ALPHABET_SIZE;a++){
-            for(int i=0;i<N;i++) mark[i]=0;
+static void budget_check_bytes(Compiler* C,const char* stage,size_t extra,int states){
+    if(C->budgets.bytes>0 && compile_bytes(C)+extra > (size_t)C->budgets.bytes)
+        budget_exceeded(C,stage,"bytes",C->budgets.bytes,states);
+}
 
-            for(int idx=0; idx<P[Ablock].n; idx++){
-                int qstate=P[Ablock].a[idx];
-                IntVec* pre=&inv[a*N+qstate];
-                for(int j=0;j<pre->n;j++) mark[pre->a[j]]=1;
-            }
+/* s must not be in the table yet (find_dfa_state returned -1) */
+static int dfa_add_state(Compiler* C,const Bitset* s,uint64_t h,const Bitset* nfa_accept){
+    if(C->dfa_budget_on){
+        if(C->budgets.dfa_states>0 && C->dfa_n>=C->budgets.dfa_states)
+            budget_exceeded(C,"dfa","dfa_states",C->budgets.dfa_states,C->dfa_n);
+        budget_check_bytes(C,"dfa",0,C->dfa_n);
+    }
+    if(C->dfa_n==C->dfa_cap){
+        C->dfa_cap = C->dfa_cap ? C->dfa_cap*2 : 64;
+        C->dfa=(DFAState*)retained_reserve(C,&C->dfa_mem,(size_t)C->dfa_cap*sizeof(DFAState));
+        C->dfa_trans=(int*)retained_reserve(C,&C->dfa_trans_mem,(size_t)C->dfa_cap*(size_t)C->n_classes*sizeof(int));
+    }
+    if(2*(unsigned)(C->dfa_n+1) > C->dfa_hash_cap) dfa_hash_grow(C);
+
+    DFAState* d=&C->dfa[C->dfa_n];
+    d->set.nwords=s->nwords;
+    d->set.w=arena_words(C,&C->set_arena,(size_t)s->nwords);
+    memcpy(d->set.w,s->w,(size_t)s->nwords*sizeof(uint64_t));
+    d->hash = h;
+    d->is_accept = bs_intersects(s,nfa_accept);
+    int* tr=&C->dfa_trans[(size_t)C->dfa_n*(size_t)C->n_classes];
+    for(int i=0;i<C->n_classes;i++) tr[i]=-1;
+    int slot = (C->dfa_hash_miss>=0 && C->dfa_miss_hash==h) ? C->dfa_hash_miss : dfa_hash_empty_slot(C,h);
+    C->dfa_hash_miss=-1;
+    C->dfa_hash[slot] = C->dfa_n;
+    return C->dfa_n++;
+}
 
-            for(int yi=0; yi<Pn; yi++){
-                int cnt=0;
-                for(int k=0;k<P[yi].n;k++) if(mark[P[yi].a[k]]) cnt++;
-                if(cnt==0 || cnt==P[yi].n) continue;
-
-                IntVec Y1; iv_init(&Y1);
-                IntVec Y2; iv_init(&Y2);
-                for(int k=0;k<P[yi].n;k++){
-                    int s=P[yi].a[k];
-                    if(mark[s]) iv_push(&Y1,s); else iv_push(&Y2,s);
-                }
-
-                iv_free(&P[yi]);
-                P[yi]=Y1;
-                int newi=Pn++;
-                P[newi]=Y2;
-
-                for(int k=0;k<P[yi].n;k++) cls[P[yi].a[k]]=yi;
-                for(int k=0;k<P[newi].n;k++) cls[P[newi].a[k]]=newi;
-
-                int found=-1;
-                for(int w=0; w<W.n; w++) if(W.a[w]==yi){ found=w; break; }
-
-                if(found>=0){
-                    W.a[found]=yi;
-                    iv_push(&W,newi);
-                } else {
-                    if(P[yi].n<=P[newi].n) iv_push(&W,yi);
-                    else iv_push(&W,newi);
-                }
+/* ===== parallel subset construction (--threads N) =====
+   Successor sets depend only on the source state's set, so they can be computed out of
+   order: worker threads fill a chunk of pending DFA states (every class of each) with
+   their successor sets and hashes, then the main thread interns them in state and
+   class order. That is the order the serial BFS adds states in, so the numbering and
+   the written .dfa are the same for any thread count, and the state table needs no
+   locking. Workers only read shared data; Thompson closures are all computed before
+   the first chunk and each worker has its own move buffer. */
+#define PAR_MIN_STATES 64          /* smaller frontiers are stepped serially */
+#define PAR_CHUNK_BYTES (16u<<20)  /* successor sets buffered per chunk */
+#define MAX_THREADS 64
+
+typedef struct {
+    int lo, n;                  /* DFA states lo .. lo+n */
+    int next;                   /* next state of the chunk to claim, taken atomically */
+    uint64_t* sets;             /* n*n_classes successor sets of nwords words */
+    uint64_t* hashes;
+    unsigned char* nonempty;
+    int nwords;
+} StepChunk;
+
+typedef struct { Compiler* C; StepChunk* chunk; Bitset mv; } StepWorker;
+
+static void* step_worker(void* arg){
+    StepWorker* wk=(StepWorker*)arg;
+    Compiler* C=wk->C;
+    StepChunk* c=wk->chunk;
+    const int K=C->n_classes;
+    for(;;){
+        int i=__atomic_fetch_add(&c->next,1,__ATOMIC_RELAXED);
+        if(i>=c->n) break;
+        const Bitset* in=&C->dfa[c->lo+i].set;
+        if(C->nfa_glushkov) glushkov_follow(C,&wk->mv,in);
+        for(int ci=0;ci<K;ci++){
+            size_t cell=(size_t)i*(size_t)K+(size_t)ci;
+            Bitset out={ &c->sets[cell*(size_t)c->nwords], c->nwords };
+            int ai=C->class_sym[ci];
+            int any = C->nfa_glushkov ? glushkov_step(C,&out,&wk->mv,ai) : dfa_step(C,&out,&wk->mv,in,ai);
+            c->nonempty[cell]=(unsigned char)any;
+            if(any) c->hashes[cell]=bs_hash(&out);
+        }
+    }
+    return NULL;
+}
+
+/* Steps DFA states lo .. lo+c->n on n_threads workers, then interns the results. */
+static void step_chunk_parallel(Compiler* C,StepChunk* c,StepWorker* wk,const Bitset* nfa_accept){
+    pthread_t tid[MAX_THREADS];
+    c->next=0;
+    int started=0;
+    for(int t=1;t<C->n_threads;t++){
+        wk[t].C=C;
+        wk[t].chunk=c;
+        if(pthread_create(&tid[t],NULL,step_worker,&wk[t])!=0) break;
+        started=t;
+    }
+    wk[0].C=C;
+    wk[0].chunk=c;
+    step_worker(&wk[0]);
+    for(int t=1;t<=started;t++) pthread_join(tid[t],NULL);
+
+    const int K=C->n_classes;
+    for(int i=0;i<c->n;i++){
+        for(int ci=0;ci<K;ci++){
+            size_t cell=(size_t)i*(size_t)K+(size_t)ci;
+            int tgt=-1;
+            if(c->nonempty[cell]){
+                Bitset cl={ &c->sets[cell*(size_t)c->nwords], c->nwords };
+                uint64_t h=c->hashes[cell];
+                tgt=find_dfa_state(C,&cl,h);
+                if(tgt<0) tgt=dfa_add_state(C,&cl,h,nfa_accept);
             }
+            C->dfa_trans[(size_t)(c->lo+i)*(size_t)K+ci]=tgt;
         }
     }
+}
 
-    for(int a=0;a<ALPHABET_SIZE;a++) for(int q=0;q<N;q++) iv_free(&inv[a*N+q]);
-    free(inv);
-    free(mark);
-    free(T);
-    free(A);
+/* ===== subset construction ===== */
+
+/* A DFA state accepts when its set meets nfa_accept. With nfa_glushkov the NFA is the
+   position automaton and its tables stand in for the CSR adjacency and closures. */
+static void nfa_to_dfa(Compiler* C,int nfa_start,const Bitset* nfa_accept){
+    ArenaMark m=arena_mark(&C->work_arena); /* NFA tables and step buffers, dropped at the end */
+    Bitset init_cl=bs_new(C,C->nfa_states);
+    if(C->nfa_glushkov){
+        bs_set(&init_cl,nfa_start);
+    } else {
+        budget_check_bytes(C,"dfa",(size_t)C->nfa_states*(size_t)init_cl.nwords*sizeof(uint64_t),0); /* closures */
+        nfa_tables_build(C,nfa_accept);
+        const uint64_t* row=state_closure(C,nfa_start);
+        for(int i=0;i<init_cl.nwords;i++) init_cl.w[i]=row[i];
+    }
 
-    *out_min_n=Pn;
+    C->dfa_n=0;
+    dfa_hash_init(C,64);
+    C->hash_lookups=C->hash_probes=0;
+    C->dfa_budget_on=1;
+    dfa_add_state(C,&init_cl,bs_hash(&init_cl),nfa_accept);
+
+    Bitset mv=bs_new(C,C->nfa_states);
+    Bitset cl=bs_new(C,C->nfa_states);
+
+    StepChunk chunk={0};
+    StepWorker wk[MAX_THREADS];
+    int chunk_cap=0;
+    if(C->n_threads>1){
+        if(!C->nfa_glushkov) for(int s=0;s<C->nfa_states;s++) state_closure(C,s);
+        size_t per=(size_t)C->n_classes*((size_t)init_cl.nwords*sizeof(uint64_t)+sizeof(uint64_t)+1);
+        size_t cap=PAR_CHUNK_BYTES/per;
+        chunk_cap = cap<PAR_MIN_STATES ? PAR_MIN_STATES : cap>(size_t)INT32_MAX/C->n_classes ? INT32_MAX/C->n_classes : (int)cap;
+        size_t cells=(size_t)chunk_cap*(size_t)C->n_classes;
+        chunk.nwords=init_cl.nwords;
+        chunk.sets=(uint64_t*)arena_alloc(C,&C->work_arena,cells*(size_t)chunk.nwords*sizeof(uint64_t));
+        chunk.hashes=(uint64_t*)arena_alloc(C,&C->work_arena,cells*sizeof(uint64_t));
+        chunk.nonempty=(unsigned char*)arena_alloc(C,&C->work_arena,cells);
+        for(int t=0;t<C->n_threads;t++) wk[t].mv=bs_new(C,C->nfa_states);
+    }
 
-    for(int i=0;i<Pn;i++) iv_free(&P[i]);
-    free(P);
-    iv_free(&W);
+    /* BFS: states are numbered in discovery order, so the queue is just 0..dfa_n */
+    for(int id=0;id<C->dfa_n;id++){
+        if(C->n_threads>1 && C->dfa_n-id>=PAR_MIN_STATES){
+            chunk.lo=id;
+            chunk.n = C->dfa_n-id<chunk_cap ? C->dfa_n-id : chunk_cap;
+            if(steps_spend((long)chunk.n*C->n_classes*init_cl.nwords)) budget_exceeded(C,"dfa","steps",steps_limit(),C->dfa_n);
+            step_chunk_parallel(C,&chunk,wk,nfa_accept);
+            id+=chunk.n-1;
+            continue;
+        }
+        if(steps_spend((long)C->n_classes*init_cl.nwords)) budget_exceeded(C,"dfa","steps",steps_limit(),C->dfa_n);
+        if(C->nfa_glushkov) glushkov_follow(C,&mv,&C->dfa[id].set);
+        for(int ci=0;ci<C->n_classes;ci++){
+            int t=-1, ai=C->class_sym[ci];
+            int any = C->nfa_glushkov ? glushkov_step(C,&cl,&mv,ai) : dfa_step(C,&cl,&mv,&C->dfa[id].set,ai);
+            if(any){
+                uint64_t h=bs_hash(&cl);
+                t=find_dfa_state(C,&cl,h);
+                if(t<0) t=dfa_add_state(C,&cl,h,nfa_accept);
+            }
+            C->dfa_trans[(size_t)id*(size_t)C->n_classes+ci]=t;
+        }
+    }
 
-    return cls;
+    C->dfa_budget_on=0;
+    C->dfa_hash=NULL; C->dfa_hash_cap=0;
+    arena_rewind(&C->work_arena,m);
 }
 
-/* ===== write machine-parsable DFA ===== */
-static void write_min_dfa(FILE* out,const int* cls,int min_n,int need_dead,int dead){
-    int N=dfa_n+(need_dead?1:0);
-
-    int* T=(int*)xmalloc((size_t)N*(size_t)ALPHABET_SIZE*sizeof(int));
-    int* A=(int*)xmalloc((size_t)N*sizeof(int));
-    for(int s=0;s<dfa_n;s++){
-        A[s]=dfa[s].is_accept;
-        for(int a=0;a<ALPHABET_SIZE;a++){
-            int t=dfa[s].trans[a];
+/* ===== minimization =====
+   Completes the subset DFA with a dead state where transitions are missing and runs
+   the shared Hopcroft minimization (automata.c) on the symbol class columns. The
+   classes of symbol_classes_build only merge symbols the regex never uses; once the
+   subset table is complete, columns that came out equal (a and b in (a+b)*) are
+   merged too (dfa_symbol_classes), and Hopcroft and write_min_dfa run on those
+   min_classes columns. Classes are numbered in BFS order from the start state (DFA
+   state 0), so equal languages always produce the same table: a symbol class is
+   visited at its first symbol, where the BFS over the whole alphabet first meets
+   that successor too. */
+
+static int* minimize_subset_dfa(Compiler* C,int* out_min_n,int* out_need_dead,int* out_dead){
+    int need_dead=0;
+    int K=C->n_classes;
+    for(size_t i=0;i<(size_t)C->dfa_n*(size_t)K;i++) if(C->dfa_trans[i]==-1) need_dead=1;
+
+    int N=C->dfa_n+(need_dead?1:0);
+    int dead=need_dead? (N-1) : -1;
+
+    *out_need_dead=need_dead;
+    *out_dead=dead;
+
+    /* cls, T and A here, then dfa_minimize's work arrays */
+    size_t NK=(size_t)N*(size_t)K;
+    budget_check_bytes(C,"min",(size_t)N*sizeof(int)+NK*sizeof(int)+(size_t)N+(3*NK+1+10*(size_t)N)*sizeof(int),N);
+
+    int* cls=(int*)arena_alloc(C,&C->work_arena,(size_t)N*sizeof(int));
+    ArenaMark m=arena_mark(&C->work_arena);
+    int* T=(int*)arena_alloc(C,&C->work_arena,(size_t)N*(size_t)K*sizeof(int));
+    unsigned char* A=(unsigned char*)arena_alloc(C,&C->work_arena,(size_t)N);
+
+    for(int s=0;s<C->dfa_n;s++){
+        A[s]=(unsigned char)C->dfa[s].is_accept;
+        for(int a=0;a<K;a++){
+            int t=C->dfa_trans[(size_t)s*K+a];
             if(t==-1) t=dead;
-            T[s*ALPHABET_SIZE+a]=t;
+            T[(size_t)s*K+a]=t;
         }
     }
     if(need_dead){
         A[dead]=0;
-        for(int a=0;a<ALPHABET_SIZE;a++) T[dead*ALPHABET_SIZE+a]=dead;
+        for(int a=0;a<K;a++) T[(size_t)dead*K+a]=dead;
     }
 
-    int* rep=(int*)xmalloc((size_t)min_n*sizeof(int));
-    for(int i=0;i<min_n;i++) rep[i]=-1;
+    /* Merged classes are numbered by their first column, so min_col grows with the
+       class and T can be packed to N x min_classes in place, front to back. */
+    unsigned char col_class[MAX_ALPHABET];
+    C->min_classes=dfa_symbol_classes(N,K,T,col_class);
+    for(int a=K-1;a>=0;a--) C->min_col[col_class[a]]=a;
+    for(int a=0;a<C->alphabet_size;a++) C->min_sym_class[a]=col_class[C->sym_class[a]];
+    if(C->min_classes<K){
+        for(int s=0;s<N;s++)
+            for(int c=0;c<C->min_classes;c++)
+                T[(size_t)s*C->min_classes+c]=T[(size_t)s*K+C->min_col[c]];
+    }
+
+    const char* err=dfa_minimize(N,C->min_classes,T,A,0,cls,out_min_n,&C->min_stats);
+    if(err && steps_exhausted()) budget_exceeded(C,"min","steps",steps_limit(),N);
+    if(err) die(C,err);
+    arena_rewind(&C->work_arena,m);
+    return cls;
+}
+
+/* ===== write machine-parsable DFA ===== */
+/* The minimized table is read off one subset state of each minimized state, on the
+   min_classes columns; rows as wide as the alphabet only exist as they are written. */
+static void write_min_dfa(Compiler* C,FILE* out){
+    double t0=now_ms();
+    const int* cls=C->min_cls;
+    int dead=C->min_dead;
+    int N=C->dfa_n+(C->min_need_dead?1:0);
+    int K=C->min_classes;
+    ArenaMark mark=arena_mark(&C->work_arena);
+
+    int* rep=(int*)arena_alloc(C,&C->work_arena,(size_t)C->min_n*sizeof(int));
+    for(int i=0;i<C->min_n;i++) rep[i]=-1;
     for(int s=0;s<N;s++) if(rep[cls[s]]==-1) rep[cls[s]]=s;
 
-    int* acc=(int*)xcalloc((size_t)min_n,sizeof(int));
-    for(int s=0;s<N;s++) if(A[s]) acc[cls[s]]=1;
+    unsigned char* acc=(unsigned char*)arena_zalloc(C,&C->work_arena,(size_t)C->min_n);
+    for(int s=0;s<C->dfa_n;s++) if(C->dfa[s].is_accept) acc[cls[s]]=1;
+
+    int* mt=(int*)arena_alloc(C,&C->work_arena,(size_t)C->min_n*(size_t)K*sizeof(int));
+    for(int c=0;c<C->min_n;c++){
+        int r=rep[c];
+        for(int a=0;a<K;a++){
+            int t = r==dead ? dead : C->dfa_trans[(size_t)r*C->n_classes+C->min_col[a]];
+            mt[(size_t)c*K+a]=cls[t==-1 ? dead : t];
+        }
+    }
+
+    if(C->write_binary){
+        int werr=dfab_write_classes(out,C->alphabet_size,C->alphabet,C->min_n,cls[0],acc,mt,K,C->min_sym_class);
+        arena_rewind(&C->work_arena,mark);
+        if(werr) die(C,"cannot write output file");
+        C->stage_ms[STAGE_WRITE]=now_ms()-t0;
+        return;
+    }
 
     int m=0;
-    for(int i=0;i<min_n;i++) if(acc[i]) m++;
+    for(int i=0;i<C->min_n;i++) if(acc[i]) m++;
 
-    fprintf(out,"ALPHABET %d ",ALPHABET_SIZE);
-    for(int i=0;i<ALPHABET_SIZE;i++) fputc(ALPHABET[i],out);
+    fprintf(out,"ALPHABET %d ",C->alphabet_size);
+    for(int i=0;i<C->alphabet_size;i++) fputc(C->alphabet[i],out);
     fprintf(out,"\n");
-    fprintf(out,"STATES %d\n",min_n);
+    fprintf(out,"STATES %d\n",C->min_n);
     fprintf(out,"START %d\n",cls[0]);
     fprintf(out,"ACCEPT %d",m);
-    for(int i=0;i<min_n;i++) if(acc[i]) fprintf(out," %d",i);
+    for(int i=0;i<C->min_n;i++) if(acc[i]) fprintf(out," %d",i);
     fprintf(out,"\n");
     fprintf(out,"TRANS\n");
 
-    for(int c=0;c<min_n;c++){
-        int r=rep[c];
-        for(int a=0;a<ALPHABET_SIZE;a++){
-            int t=T[r*ALPHABET_SIZE+a];
-            int tc=cls[t];
-            fprintf(out,"%d%s",tc,(a==ALPHABET_SIZE-1)?"":" ");
-        }
+    for(int c=0;c<C->min_n;c++){
+        const int* row=&mt[(size_t)c*K];
+        for(int a=0;a<C->alphabet_size;a++)
+            fprintf(out,"%d%s",row[C->min_sym_class[a]],(a==C->alphabet_size-1)?"":" ");
         fprintf(out,"\n");
     }
     fprintf(out,"END\n");
 
-    free(T); free(A); free(rep); free(acc);
+    arena_rewind(&C->work_arena,mark);
+    C->stage_ms[STAGE_WRITE]=now_ms()-t0;
 }
 
 /* ===== helpers ===== */
+
+/* Ends a compilation (also one cut short by a die()), keeping its memory for the next
+   one; see "compilation memory". */
+static void compiler_reset(Compiler* C){
+    arena_reset(&C->work_arena);
+    arena_reset(&C->set_arena);
+    retained_trim(&C->dfa_mem,ARENA_KEEP_BYTES);
+    retained_trim(&C->dfa_trans_mem,ARENA_KEEP_BYTES);
+    retained_trim(&C->hash_mem,ARENA_KEEP_BYTES);
+    retained_trim(&C->hash_spare,ARENA_KEEP_BYTES);
+    C->nfa=NULL; C->nfa_states=C->nfa_cap=0;
+    C->dfa=NULL; C->dfa_trans=NULL; C->dfa_n=C->dfa_cap=0;
+    C->dfa_hash=NULL; C->dfa_hash_cap=0;
+    C->sym_off=C->sym_to=C->eps_off=C->eps_to=C->work=NULL;
+    C->clos=NULL; C->clos_done=NULL; C->clos_key=NULL;
+    C->gfrag_st=(GFragStack){0};
+    C->g_follow=C->g_mask=NULL; C->g_nwords=0;
+    C->nfa_accept_set=(Bitset){0};
+    C->rx_pre=C->rx_cat=C->rx_post=NULL; C->min_cls=NULL;
+    C->rx_nodes=NULL; C->rx_table=NULL; C->rx_seen=NULL; C->rx_bail=NULL;
+    C->dfa_budget_on=0;
+    dfa_table_free(&C->check_ref);
+    test_reader_close(&C->check_reader);
+    C->lazy_built=C->lazy_flushes=C->tests_run=C->check_bytes=0;
+    C->bp_on=0; C->bp_follow=NULL;
+    C->lz_start_id=-1;
+}
+
 static int read_two_lines(FILE* f,char* l1,size_t n1,char* l2,size_t n2){
     if(!fgets(l1,(int)n1,f)) return 0;
     if(!fgets(l2,(int)n2,f)) return 0;
     return 1;
 }
 
-int main(int argc,char** argv){
-    if(argc!=3){
-        fprintf(stderr,"Usage: %s <input_file> <output_dfa_file>\n",argv[0]);
-        return 1;
+/* Parse the two-line input and build the NFA (Thompson or Glushkov); returns its
+   start state, the accepting states are left in nfa_accept_set. A regex with fewer
+   than glushkov_below positions gets the Glushkov NFA whatever use_glushkov says. */
+static int compile_front(Compiler* C,FILE* fin,int glushkov_below){
+    char line_regex[4096], line_alpha[4096];
+    if(!read_two_lines(fin,line_regex,sizeof(line_regex),line_alpha,sizeof(line_alpha)))
+        die(C,"input must have 2 lines: regex then alphabet");
+
+    compiler_reset(C);
+    C->budget_hit=0;
+    double t0=now_ms();
+    C->compile_t0=t0;
+    parse_alphabet_line(C,line_alpha);
+
+    C->rx_pre=preprocess_regex(C,line_regex);
+    if(C->rx_pre[0]=='\0') die(C,"empty regex");
+    check_regex_symbols_valid(C,C->rx_pre);
+    check_parentheses_balanced(C,C->rx_pre);
+
+    C->rx_cat=add_concat_ops(C,C->rx_pre);
+    C->rx_post=to_postfix(C,C->rx_cat);
+    if(C->use_simplify) simplify_postfix(C,C->rx_post);
+    nfa_reserve(C,strlen(C->rx_post));
+    double t1=now_ms();
+
+    int nfa_start=0;
+    C->nfa_glushkov = C->use_glushkov || glushkov_positions(C,C->rx_post)<glushkov_below;
+    if(C->nfa_glushkov){
+        postfix_to_glushkov(C,C->rx_post,&C->nfa_accept_set);
+    } else {
+        Frag frag=postfix_to_nfa(C,C->rx_post);
+        nfa_start=frag.start;
+        C->nfa_accept_set=bs_new(C,C->nfa_states);
+        bs_set(&C->nfa_accept_set,frag.accept);
     }
+    symbol_classes_build(C,C->rx_post);
+    if(C->budgets.nfa_states>0 && C->nfa_states>C->budgets.nfa_states)
+        budget_exceeded(C,"nfa","nfa_states",C->budgets.nfa_states,C->nfa_states);
+    budget_check_bytes(C,"nfa",0,C->nfa_states);
+    double t2=now_ms();
+
+    C->stage_ms[STAGE_PARSE]=t1-t0;
+    C->stage_ms[STAGE_NFA]=t2-t1;
+    C->stage_ms[STAGE_DFA]=0;
+    C->stage_ms[STAGE_MIN]=0;
+    C->stage_ms[STAGE_WRITE]=0;
+    return nfa_start;
+}
 
-    FILE* fin=fopen(argv[1],"r");
-    if(!fin) die("cannot open input file");
+/* Parse the two-line input and run the whole pipeline; the result is left in
+   min_cls/min_n/min_need_dead/min_dead for write_min_dfa. */
+static void compile_input(Compiler* C,FILE* fin){
+    int nfa_start=compile_front(C,fin,0);
+    double t2=now_ms();
+    nfa_to_dfa(C,nfa_start,&C->nfa_accept_set);
+    double t3=now_ms();
 
-    char line_regex[4096], line_alpha[4096];
-    if(!read_two_lines(fin,line_regex,sizeof(line_regex),line_alpha,sizeof(line_alpha))){
-        fclose(fin);
-        die("input must have 2 lines: regex then alphabet");
+    C->min_cls=minimize_subset_dfa(C,&C->min_n,&C->min_need_dead,&C->min_dead);
+    double t4=now_ms();
+
+    C->stage_ms[STAGE_DFA]=t3-t2;
+    C->stage_ms[STAGE_MIN]=t4-t3;
+    C->stage_ms[STAGE_WRITE]=0;
+}
+
+/* ===== Compiler (see regex2mindfa.h) ===== */
+
+void compiler_options_default(CompilerOptions* o){
+    memset(o,0,sizeof(*o));
+    o->simplify=1;
+    o->bitparallel=1;
+    o->threads=1;
+}
+
+void compiler_set_options(Compiler* C,const CompilerOptions* o){
+    C->write_binary=o->binary;
+    C->use_glushkov=o->glushkov;
+    C->use_simplify=o->simplify;
+    C->use_bitparallel=o->bitparallel;
+    C->n_threads = o->threads<1 ? 1 : o->threads>MAX_THREADS ? MAX_THREADS : o->threads;
+    C->budgets.nfa_states=o->max_nfa_states;
+    C->budgets.dfa_states=o->max_dfa_states;
+    C->budgets.bytes=o->max_bytes;
+}
+
+Compiler* compiler_new(const CompilerOptions* o){
+    Compiler* C=(Compiler*)calloc(1,sizeof(Compiler));
+    if(!C) return NULL;
+    C->min_dead=-1;
+    C->lz_start_id=-1;
+    compiler_set_options(C,o);
+    return C;
+}
+
+/* compiler_reset() that also gives the memory back. */
+void compiler_free(Compiler* C){
+    if(!C) return;
+    compiler_reset(C);
+    arena_release(&C->work_arena);
+    arena_release(&C->set_arena);
+    retained_trim(&C->dfa_mem,0);
+    retained_trim(&C->dfa_trans_mem,0);
+    retained_trim(&C->hash_mem,0);
+    retained_trim(&C->hash_spare,0);
+    free(C);
+}
+
+/* A die() unwound a compiler_compile / compiler_write: ends the compilation and
+   returns the exit code. */
+static int compiler_failed(Compiler* C){
+    int code = C->budget_hit || steps_exhausted() ? STEPS_EXCEEDED_EXIT : 1;
+    C->die_jmp=NULL;
+    C->err_out=NULL;
+    C->budget_hit=0;
+    compiler_reset(C);
+    return code;
+}
+
+int compiler_compile(Compiler* C,FILE* in,FILE* err){
+    jmp_buf jb;
+    C->err_out=err;
+    C->die_jmp=&jb;
+    if(setjmp(jb)!=0) return compiler_failed(C);
+    compile_input(C,in);
+    C->die_jmp=NULL;
+    C->err_out=NULL;
+    return 0;
+}
+
+int compiler_write(Compiler* C,FILE* out,FILE* err){
+    jmp_buf jb;
+    C->err_out=err;
+    C->die_jmp=&jb;
+    if(setjmp(jb)!=0) return compiler_failed(C);
+    write_min_dfa(C,out);
+    C->die_jmp=NULL;
+    C->err_out=NULL;
+    return 0;
+}
+
+void compiler_stats(const Compiler* C,CompilerStats* st){
+    st->parse_ms=C->stage_ms[STAGE_PARSE];
+    st->nfa_ms=C->stage_ms[STAGE_NFA];
+    st->dfa_ms=C->stage_ms[STAGE_DFA];
+    st->min_ms=C->stage_ms[STAGE_MIN];
+    st->write_ms=C->stage_ms[STAGE_WRITE];
+    st->nfa_states=C->nfa_states;
+    st->dfa_states=C->dfa_n;
+    st->min_states=C->min_n;
+}
+
+#ifndef REGEX2MINDFA_NO_MAIN /* bench_compiler.c and build_problems.c link the pipeline only */
+
+/* --stats: one "STATS <json>" line on f after the DFA is written. */
+static void print_stats(Compiler* C,FILE* f){
+    double total=0;
+    for(int i=0;i<STAGE_COUNT;i++) total+=C->stage_ms[i];
+    fprintf(f,"STATS {\"tool\":\"regex2mindfa\",\"nfa\":\"%s\",\"parse_ms\":%.3f,\"nfa_ms\":%.3f,\"dfa_ms\":%.3f,"
+            "\"min_ms\":%.3f,\"write_ms\":%.3f,\"total_ms\":%.3f,\"nfa_states\":%d,\"dfa_states\":%d,"
+            "\"min_states\":%d,\"hopcroft_pops\":%ld,\"hopcroft_splits\":%ld,\"hash_lookups\":%ld,\"hash_probes\":%ld}\n",
+            C->nfa_glushkov ? "glushkov" : "thompson",
+            C->stage_ms[STAGE_PARSE],C->stage_ms[STAGE_NFA],C->stage_ms[STAGE_DFA],C->stage_ms[STAGE_MIN],C->stage_ms[STAGE_WRITE],total,
+            C->nfa_states,C->dfa_n,C->min_n,C->min_stats.pops,C->min_stats.splits,C->hash_lookups,C->hash_probes);
+}
+
+/* ===== --check: lazy DFA =====
+   Grades the regex against a reference .dfa on a tests file without determinizing it
+   up front. DFA states (NFA state sets, as in nfa_to_dfa) are built on the first
+   transition that reaches them and kept in dfa[] with LAZY_UNKNOWN transitions until
+   each is taken. The cache is bounded by LAZY_CACHE_BYTES; when a new state would not
+   fit, every cached state is dropped and the walk carries on from the current set, so
+   the cost follows the test strings rather than the full subset construction.
+   Output and exit codes are those of dfa_checker on the compiled regex. A test costs
+   steps like one in dfa_checker, and a transition built costs one step per set word. */
+#ifndef LAZY_CACHE_BYTES
+#define LAZY_CACHE_BYTES (32u<<20)
+#endif
+#define LAZY_UNKNOWN (-2)
+
+static void lazy_init(Compiler* C,int nfa_start){
+    if(!C->nfa_glushkov) nfa_tables_build(C,&C->nfa_accept_set);
+    C->lz_mv=bs_new(C,C->nfa_states);
+    C->lz_cl=bs_new(C,C->nfa_states);
+    C->lz_keep=bs_new(C,C->nfa_states);
+    C->lz_start=bs_new(C,C->nfa_states);
+    if(C->nfa_glushkov) bs_set(&C->lz_start,nfa_start);
+    else memcpy(C->lz_start.w,state_closure(C,nfa_start),(size_t)C->lz_start.nwords*sizeof(uint64_t));
+
+    size_t per=(size_t)C->lz_start.nwords*sizeof(uint64_t) + (size_t)C->n_classes*sizeof(int) + sizeof(DFAState);
+    size_t cap=LAZY_CACHE_BYTES/per;
+    C->lz_cap = cap<16 ? 16 : cap>(size_t)INT32_MAX/2 ? INT32_MAX/2 : (int)cap;
+    C->dfa_n=0;
+    dfa_hash_init(C,64);
+    C->lz_start_id=-1;
+}
+
+static int lazy_add(Compiler* C,const Bitset* s,uint64_t h){
+    int id=dfa_add_state(C,s,h,&C->nfa_accept_set);
+    int* tr=&C->dfa_trans[(size_t)id*(size_t)C->n_classes];
+    for(int i=0;i<C->n_classes;i++) tr[i]=LAZY_UNKNOWN;
+    C->lazy_built++;
+    return id;
+}
+
+/* Empties the cache except for state cur, which is re-added; returns its new id. */
+static int lazy_flush(Compiler* C,int cur){
+    memcpy(C->lz_keep.w,C->dfa[cur].set.w,(size_t)C->lz_keep.nwords*sizeof(uint64_t));
+    uint64_t h=C->dfa[cur].hash;
+    C->dfa_n=0;
+    arena_reset(&C->set_arena);
+    dfa_hash_init(C,64);
+    C->lz_start_id=-1;
+    C->lazy_flushes++;
+    return lazy_add(C,&C->lz_keep,h);
+}
+
+static int lazy_start_state(Compiler* C){
+    if(C->lz_start_id<0){
+        uint64_t h=bs_hash(&C->lz_start);
+        C->lz_start_id=find_dfa_state(C,&C->lz_start,h);
+        if(C->lz_start_id<0) C->lz_start_id=lazy_add(C,&C->lz_start,h);
     }
-    fclose(fin);
+    return C->lz_start_id;
+}
 
-    parse_alphabet_line(line_alpha);
+/* Transition of cached state cur on symbol class ci; -1 is the dead state. A flush
+   renumbers cur, so the caller passes it by pointer. */
+static int lazy_next(Compiler* C,int* cur,int ci){
+    int t=C->dfa_trans[(size_t)*cur*(size_t)C->n_classes+ci];
+    if(t!=LAZY_UNKNOWN) return t;
+
+    if(steps_spend(C->lz_cl.nwords)) die(C,"step budget exceeded");
+    int ai=C->class_sym[ci];
+    int any;
+    if(C->nfa_glushkov){
+        glushkov_follow(C,&C->lz_mv,&C->dfa[*cur].set);
+        any=glushkov_step(C,&C->lz_cl,&C->lz_mv,ai);
+    } else {
+        any=dfa_step(C,&C->lz_cl,&C->lz_mv,&C->dfa[*cur].set,ai);
+    }
+    t=-1;
+    if(any){
+        uint64_t h=bs_hash(&C->lz_cl);
+        t=find_dfa_state(C,&C->lz_cl,h);
+        if(t<0){
+            if(C->dfa_n>=C->lz_cap) *cur=lazy_flush(C,*cur);
+            t=lazy_add(C,&C->lz_cl,h);
+        }
+    }
+    C->dfa_trans[(size_t)*cur*(size_t)C->n_classes+ci]=t;
+    return t;
+}
 
-    char* regex0=preprocess_regex(line_regex);
-    if(regex0[0]=='\0') die("empty regex");
-    check_regex_symbols_valid(regex0);
-    check_parentheses_balanced(regex0);
+/* Runs the reference table and the lazy DFA over w together. Returns 1/0 for the
+   user's verdict and sets *ref_accept, or -1 if w has a symbol outside the alphabet. */
+static int lazy_run(Compiler* C,const DfaTable* ref,const char* w,size_t len,int* ref_accept){
+    int r=ref->start;
+    int u=lazy_start_state(C);
+    for(size_t i=0;i<len;i++){
+        int ai=C->sym_index[(unsigned char)w[i]];
+        if(ai<0) return -1;
+        r=ref->trans[(size_t)r*(size_t)ref->k+(size_t)ai];
+        if(u>=0) u=lazy_next(C,&u,C->sym_class[ai]);
+    }
+    C->check_bytes+=(long)len;
+    *ref_accept=ref->acc[r];
+    return u>=0 ? C->dfa[u].is_accept : 0;
+}
 
-    for(int i=0;i<nfa_states;i++) free(nfa[i].edges);
-    nfa_states=0;
-    for(int i=0;i<dfa_n;i++) bs_free(&dfa[i].set);
-    dfa_n=0;
+/* ===== --check: bit-parallel Glushkov simulation =====
+   A regex with fewer than BP_MAX_STATES positions is compiled to its position
+   automaton (see "Glushkov position automaton"), whose m+1 states fit in one word,
+   and the tests run on that word directly instead of through the lazy DFA:
+     D' = follow(D) & g_mask[a]
+   follow(D) is looked up 8 bits at a time in bp_follow, whose row j holds, for each
+   byte b, the union of follow(8j+i) over the bits i of b; the loop stops at the
+   highest set bit, so a short regex costs one lookup per symbol. Nothing is
+   determinized and a test costs the same whatever the size of the regex's DFA.
+   --no-bitparallel keeps the lazy DFA for every regex. */
+#define BP_MAX_STATES 64
+
+static void bp_init(Compiler* C){
+    int rows=(C->nfa_states+7)/8;
+    C->bp_follow=arena_alloc(C,&C->work_arena,(size_t)rows*sizeof(*C->bp_follow));
+    for(int j=0;j<rows;j++){
+        C->bp_follow[j][0]=0;
+        for(int b=1;b<256;b++){
+            int p=8*j+__builtin_ctz((unsigned)b);
+            C->bp_follow[j][b]=C->bp_follow[j][b&(b-1)] | (p<C->nfa_states ? C->g_follow[p] : 0); /* g_nwords is 1 */
+        }
+    }
+    C->bp_accept=C->nfa_accept_set.w[0];
+    C->bp_on=1;
+}
 
-    char* regex1=add_concat_ops(regex0);
-    char* post=to_postfix(regex1);
+/* lazy_run() on the position automaton's state word. */
+static int bp_run(Compiler* C,const DfaTable* ref,const char* w,size_t len,int* ref_accept){
+    int r=ref->start;
+    uint64_t d=1; /* state 0, the initial one */
+    for(size_t i=0;i<len;i++){
+        int ai=C->sym_index[(unsigned char)w[i]];
+        if(ai<0) return -1;
+        r=ref->trans[(size_t)r*(size_t)ref->k+(size_t)ai];
+        uint64_t f=0;
+        for(int j=0;d;j++,d>>=8) f|=C->bp_follow[j][d&255];
+        d=f&C->g_mask[ai];
+    }
+    C->check_bytes+=(long)len;
+    *ref_accept=ref->acc[r];
+    return (d&C->bp_accept)!=0;
+}
 
-    Frag frag=postfix_to_nfa(post);
-    nfa_to_dfa(frag.start,frag.accept);
+static int check_tests(Compiler* C,const DfaTable* ref,const char* tests,size_t tests_len,FILE* out){
+    if(ref->k!=C->alphabet_size || memcmp(ref->alphabet,C->alphabet,(size_t)ref->k)!=0){
+        fprintf(errs(C),"FAIL: alphabets differ between reference and user DFA.\n");
+        fprintf(errs(C),"ref: %s\nuser:%.*s\n", ref->alphabet, C->alphabet_size, C->alphabet);
+        return 2;
+    }
 
-    int min_n=0, need_dead=0, dead=-1;
-    int* cls=dfa_minimize(&min_n,&need_dead,&dead);
+    TestReader* tr=&C->check_reader;
+    const char* err=test_reader_open(tr,tests,tests_len);
+    if(err) die(C,err);
+    int code=0;
+    for(;;){
+        int label=0;
+        const char* w=NULL;
+        size_t wlen=0;
+        int r=test_reader_next(tr,&label,&w,&wlen,&err);
+        if(r==0) break;
+        int line_no=tr->line_no;
+        if(r<0){
+            if(r==-2) fprintf(errs(C),"Error: %s\n", err);
+            else fprintf(errs(C),"Error: tests line %d: %s\n", line_no, err);
+            code=1;
+            break;
+        }
 
-    FILE* fout=fopen(argv[2],"w");
-    if(!fout) die("cannot open output file for writing");
-    write_min_dfa(fout,cls,min_n,need_dead,dead);
-    fclose(fout);
+        if(steps_spend(1+(long)(wlen>>5))) die(C,"step budget exceeded");
+        int rref=0;
+        int rusr=C->bp_on ? bp_run(C,ref,w,wlen,&rref) : lazy_run(C,ref,w,wlen,&rref);
+        if(rusr<0){
+            fprintf(errs(C),"Error: tests line %d: string contains symbol not in alphabet\n", line_no);
+            code=1;
+            break;
+        }
+        C->tests_run++;
+
+        if(rref!=rusr){
+            fprintf(errs(C),"FAIL at test line %d\n", line_no);
+            if(wlen==0) fprintf(errs(C),"  w = <eps>\n");
+            else fprintf(errs(C),"  w = %.*s\n", (int)wlen, w);
+            fprintf(errs(C),"  ref_accept = %d, user_accept = %d\n", rref, rusr);
+            fprintf(errs(C),"  label = %d\n", label);
+            code=2;
+            break;
+        }
+        if(rref!=label){
+            fprintf(errs(C),"WARNING: test label mismatch vs reference at line %d (label=%d, ref=%d)\n",
+                    line_no, label, rref);
+        }
+    }
 
-    free(cls);
-    free(regex0); free(regex1); free(post);
-    for(int i=0;i<nfa_states;i++) free(nfa[i].edges);
-    for(int i=0;i<dfa_n;i++) bs_free(&dfa[i].set);
+    if(code==0) fprintf(out,"PASS: %ld tests matched (user DFA behavior == reference DFA behavior).\n", C->tests_run);
+    return code;
+}
+
+static void print_check_stats(Compiler* C,double check_ms){
+    fprintf(errs(C),"STATS {\"tool\":\"regex2mindfa\",\"mode\":\"check\",\"nfa\":\"%s\",\"sim\":\"%s\",\"parse_ms\":%.3f,"
+            "\"nfa_ms\":%.3f,\"check_ms\":%.3f,\"total_ms\":%.3f,\"nfa_states\":%d,\"lazy_states\":%ld,"
+            "\"lazy_flushes\":%ld,\"tests\":%ld,\"bytes\":%ld}\n",
+            C->nfa_glushkov ? "glushkov" : "thompson", C->bp_on ? "bitparallel" : "lazy",
+            C->stage_ms[STAGE_PARSE],C->stage_ms[STAGE_NFA],check_ms,C->stage_ms[STAGE_PARSE]+C->stage_ms[STAGE_NFA]+check_ms,
+            C->nfa_states,C->lazy_built,C->lazy_flushes,C->tests_run,C->check_bytes);
+}
+
+/* --check of the input read from fin against a reference .dfa and a tests file held
+   in memory; returns the tool's exit code. The reference and the tests reader are
+   C's, so compiler_reset() releases them also after a die(). */
+static int check_input(Compiler* C,FILE* fin,const char* ref,size_t ref_len,const char* tests,size_t tests_len,
+                       FILE* out,int show_stats){
+    int nfa_start=compile_front(C,fin,C->use_bitparallel ? BP_MAX_STATES : 0);
+    const char* err=dfa_table_load(ref,ref_len,&C->check_ref);
+    if(err) die(C,err);
+
+    double t0=now_ms();
+    if(C->use_bitparallel && C->nfa_glushkov && C->nfa_states<=BP_MAX_STATES) bp_init(C);
+    else lazy_init(C,nfa_start);
+    int code=check_tests(C,&C->check_ref,tests,tests_len,out);
+    double check_ms=now_ms()-t0;
+    if(show_stats) print_check_stats(C,check_ms);
+    return code;
+}
+
+/* check_input() with its errors written to err, as compiler_compile(). */
+static int check_one(Compiler* C,FILE* fin,const char* ref,size_t ref_len,const char* tests,size_t tests_len,
+                     FILE* out,FILE* err,int show_stats){
+    jmp_buf jb;
+    C->err_out=err;
+    C->die_jmp=&jb;
+    if(setjmp(jb)!=0) return compiler_failed(C);
+    int code=check_input(C,fin,ref,ref_len,tests,tests_len,out,show_stats);
+    C->die_jmp=NULL;
+    C->err_out=NULL;
+    compiler_reset(C);
+    return code;
+}
+
+#ifndef GRADER_LIBRARY
+
+static int check_main(Compiler* C,const char* in_path,const char* ref_path,const char* tests_path,int show_stats){
+    FILE* fin=open_stream(in_path,"r");
+    if(!fin) die(C,"cannot open input file");
+    MappedFile mr, mt;
+    if(map_file(ref_path,&mr)) die(C,"cannot open DFA file");
+    if(map_file(tests_path,&mt)) die(C,"cannot open tests file");
+    int code=check_one(C,fin,(const char*)mr.data,mr.len,(const char*)mt.data,mt.len,stdout,stderr,show_stats);
+    close_stream(fin);
+    unmap_file(&mr);
+    unmap_file(&mt);
+    return code;
+}
+
+#endif /* GRADER_LIBRARY */
+
+/* ===== --serve ===== */
+
+typedef struct { Compiler* C; int check, show_stats; } Serving;
+
+/* One request of the SERVE PROTOCOL, its errors written to ferr (compiler_compile() and
+   check_one() catch them); fin reads the input field, and with check the ref and tests
+   fields are given as well. */
+static int serve_one(void* ctx,char** fields,const size_t* lens,FILE* fin,FILE* fout,FILE* ferr){
+    Serving* sv=(Serving*)ctx;
+    Compiler* C=sv->C;
+#ifndef GRADER_LIBRARY
+    steps_begin(C->budgets.steps); /* --max-steps is per request; a call's budget is its caller's */
+#endif
+    if(sv->check) return check_one(C,fin,fields[1],lens[1],fields[2],lens[2],fout,ferr,sv->show_stats);
+    int code=compiler_compile(C,fin,ferr);
+    if(code==0) code=compiler_write(C,fout,ferr);
+    if(code==0 && sv->show_stats) print_stats(C,ferr);
+    compiler_reset(C);
+    return code;
+}
+
+#ifdef GRADER_LIBRARY
+
+/* ===== in-process requests (see automata.h) =====
+   A call takes an idle Compiler, or makes one, and gives it back when done, so warm
+   Compilers are shared by whichever threadpool threads call next. */
+static pthread_mutex_t idle_lock=PTHREAD_MUTEX_INITIALIZER;
+static Compiler* idle_compilers=NULL;
+
+static Compiler* compiler_take(const CompilerOptions* opt){
+    pthread_mutex_lock(&idle_lock);
+    Compiler* C=idle_compilers;
+    if(C) idle_compilers=C->next_idle;
+    pthread_mutex_unlock(&idle_lock);
+    if(!C) return compiler_new(opt);
+    compiler_set_options(C,opt);
+    return C;
+}
+
+static void compiler_give_back(Compiler* C){
+    pthread_mutex_lock(&idle_lock);
+    C->next_idle=idle_compilers;
+    idle_compilers=C;
+    pthread_mutex_unlock(&idle_lock);
+}
+
+int regex2mindfa_call(const char* flags,char** fields,const size_t* lens,ToolOutput* o){
+    CompilerOptions opt;
+    compiler_options_default(&opt);
+    opt.binary=has_flag(flags,"--binary");
+    opt.glushkov=has_flag(flags,"--glushkov");
+    opt.simplify=!has_flag(flags,"--no-simplify");
+    opt.bitparallel=!has_flag(flags,"--no-bitparallel");
+    opt.threads=(int)flag_long(flags,"--threads",1);
+    opt.max_nfa_states=flag_long(flags,"--max-nfa-states",0);
+    opt.max_dfa_states=flag_long(flags,"--max-dfa-states",0);
+    opt.max_bytes=flag_long(flags,"--max-bytes",0);
+    Compiler* C=compiler_take(&opt);
+    if(!C){
+        memset(o,0,sizeof(*o));
+        o->err=strdup("Error: out of memory\n");
+        o->err_len=o->err ? strlen(o->err) : 0;
+        return 1;
+    }
+    Serving sv={ C, has_flag(flags,"--check"), has_flag(flags,"--stats") };
+    ServeTool t={ sv.check ? 3 : 1, 0, serve_one, NULL, &sv, NULL, NULL };
+    int code=serve_call(&t,fields,lens,o);
+    compiler_give_back(C);
+    return code;
+}
+
+#else
+
+static int compile_main(Compiler* C,const char* in_path,const char* out_path,int show_stats){
+    FILE* fin=open_stream(in_path,"r");
+    if(!fin) die(C,"cannot open input file");
+    compile_input(C,fin);
+    close_stream(fin);
+
+    FILE* fout=open_stream(out_path,C->write_binary ? "wb" : "w");
+    if(!fout) die(C,"cannot open output file for writing");
+    write_min_dfa(C,fout);
+    if(close_stream(fout)!=0) die(C,"cannot write output file");
+    if(show_stats) print_stats(C,stderr);
+    return 0;
+}
+
+static int serve(Compiler* C,int check,int show_stats){
+    Serving sv={ C, check, show_stats };
+    ServeTool t={ check ? 3 : 1, 0, serve_one, NULL, &sv, NULL, NULL };
+    const char* err=serve_requests(&t);
+    if(err) die(C,err);
     return 0;
 }
+
+int main(int argc,char** argv){
+    int show_stats=0, serve_mode=0, check_mode=0;
+    long max_steps=0;
+    CompilerOptions opt;
+    compiler_options_default(&opt);
+    int argi=1;
+    for(; argi<argc && strncmp(argv[argi],"--",2)==0; argi++){
+        if(strcmp(argv[argi],"--stats")==0) show_stats=1;
+        else if(strcmp(argv[argi],"--serve")==0) serve_mode=1;
+        else if(strcmp(argv[argi],"--binary")==0) opt.binary=1;
+        else if(strcmp(argv[argi],"--glushkov")==0) opt.glushkov=1;
+        else if(strcmp(argv[argi],"--no-simplify")==0) opt.simplify=0;
+        else if(strcmp(argv[argi],"--no-bitparallel")==0) opt.bitparallel=0;
+        else if(strcmp(argv[argi],"--check")==0) check_mode=1;
+        else if(strcmp(argv[argi],"--threads")==0 && argi+1<argc) opt.threads=atoi(argv[++argi]);
+        else if(strcmp(argv[argi],"--max-nfa-states")==0 && argi+1<argc) opt.max_nfa_states=atol(argv[++argi]);
+        else if(strcmp(argv[argi],"--max-dfa-states")==0 && argi+1<argc) opt.max_dfa_states=atol(argv[++argi]);
+        else if(strcmp(argv[argi],"--max-bytes")==0 && argi+1<argc) opt.max_bytes=atol(argv[++argi]);
+        else if(strcmp(argv[argi],"--max-steps")==0 && argi+1<argc) max_steps=atol(argv[++argi]);
+        else break;
+    }
+    Compiler* C=compiler_new(&opt);
+    if(!C){ fprintf(stderr,"Error: out of memory\n"); return 1; }
+    C->budgets.steps=max_steps;
+    steps_begin(max_steps);
+    int code;
+    if(serve_mode && argc-argi==0) code=serve(C,check_mode,show_stats);
+    else if(check_mode && !serve_mode && argc-argi==3) code=check_main(C,argv[argi],argv[argi+1],argv[argi+2],show_stats);
+    else if(!serve_mode && !check_mode && argc-argi==2) code=compile_main(C,argv[argi],argv[argi+1],show_stats);
+    else {
+        fprintf(stderr,"Usage: %s [--stats] [--binary] [--glushkov] [--no-simplify] [--threads N] [budgets] <input_file> <output_dfa_file>\n",argv[0]);
+        fprintf(stderr,"       %s [--stats] [--binary] [--glushkov] [--no-simplify] [--threads N] [budgets] --serve\n",argv[0]);
+        fprintf(stderr,"       %s [--stats] [--glushkov] [--no-simplify] [--no-bitparallel] [budgets] --check <input_file> <ref.dfa> <tests.txt>\n",argv[0]);
+        fprintf(stderr,"       %s [--stats] [--glushkov] [--no-simplify] [--no-bitparallel] [budgets] --check --serve\n",argv[0]);
+        fprintf(stderr,"budgets: --max-nfa-states N --max-dfa-states N --max-bytes N --max-steps N\n");
+        code=1;
+    }
+    compiler_free(C);
+    return code;
+}
+
+#endif /* GRADER_LIBRARY */
+#endif /* REGEX2MINDFA_NO_MAIN */
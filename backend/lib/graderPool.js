@@ -0,0 +1,151 @@
+/*
+  graderPool.js
+
+  Pool of long-running C grader processes started as `<tool> --serve`.
+
+  A worker answers one request at a time over its stdin/stdout (see SERVE PROTOCOL
+  in backend/c/*.c):
+    request : "<len1> <len2> ...\n" followed by the raw field bytes
+    response: "<exit_code> <stdout_len> <stderr_len>\n" followed by both bodies
+
+  run() resolves with the same { code, stdout, stderr } shape runCmd gives for a
+  spawned process. A request that exceeds its timeout gets its worker SIGKILLed and
+  replaced, so a runaway regex costs one process restart instead of a hung worker.
+
+  runPinned() sends a request to one of `size` extra workers picked by slot, queued
+  behind that worker's earlier requests, for state a worker keeps between requests
+  (dfa_checker editor sessions). A replaced pinned worker starts empty.
+*/
+const { spawn } = require("child_process");
+
+class GraderWorker {
+  constructor(bin, args) {
+    this.alive = true;
+    this.buf = Buffer.alloc(0);
+    this.pending = null;
+
+    this.proc = spawn(bin, [...args, "--serve"], { stdio: ["pipe", "pipe", "pipe"] });
+    this.proc.stdout.on("data", (d) => this.onData(d));
+    this.proc.stderr.on("data", () => {});
+    this.proc.stdin.on("error", () => {});
+    this.proc.on("error", () => this.onExit("[server] grader worker failed to start"));
+    this.proc.on("close", () => this.onExit("[server] grader worker exited"));
+  }
+
+  run(fields, timeoutMs) {
+    return new Promise((resolve) => {
+      const bufs = fields.map((f) => (Buffer.isBuffer(f) ? f : Buffer.from(String(f), "utf-8")));
+      const header = Buffer.from(bufs.map((b) => b.length).join(" ") + "\n", "utf-8");
+
+      const timer = setTimeout(() => {
+        this.finish({ code: null, stdout: "", stderr: `\n[server] timeout after ${timeoutMs}ms` });
+        this.kill();
+      }, timeoutMs);
+
+      this.pending = { resolve, timer };
+      this.proc.stdin.write(Buffer.concat([header, ...bufs]));
+    });
+  }
+
+  onData(d) {
+    this.buf = this.buf.length ? Buffer.concat([this.buf, d]) : d;
+    if (!this.pending) return;
+
+    const nl = this.buf.indexOf(10);
+    if (nl < 0) return;
+    const [code, outLen, errLen] = this.buf.subarray(0, nl).toString("utf-8").split(" ").map(Number);
+    const total = nl + 1 + outLen + errLen;
+    if (this.buf.length < total) return;
+
+    const stdout = this.buf.subarray(nl + 1, nl + 1 + outLen).toString("utf-8");
+    const stderr = this.buf.subarray(nl + 1 + outLen, total).toString("utf-8");
+    this.buf = this.buf.subarray(total);
+    this.finish({ code, stdout, stderr });
+  }
+
+  onExit(msg) {
+    this.alive = false;
+    this.finish({ code: null, stdout: "", stderr: `\n${msg}` });
+  }
+
+  finish(result) {
+    const p = this.pending;
+    if (!p) return;
+    this.pending = null;
+    clearTimeout(p.timer);
+    p.resolve(result);
+  }
+
+  kill() {
+    this.alive = false;
+    this.proc.kill("SIGKILL");
+  }
+}
+
+class GraderPool {
+  constructor(bin, size, args = []) {
+    this.bin = bin;
+    this.args = args;
+    this.size = Math.max(1, size);
+    this.count = 0;
+    this.idle = [];
+    this.waiting = [];
+    this.pinned = [];
+  }
+
+  async run(fields, { timeoutMs }) {
+    const w = await this.acquire();
+    try {
+      return await w.run(fields, timeoutMs);
+    } finally {
+      this.release(w);
+    }
+  }
+
+  runPinned(slot, fields, { timeoutMs }) {
+    const i = slot % this.size;
+    if (!this.pinned[i]) this.pinned[i] = { worker: null, tail: Promise.resolve() };
+    const p = this.pinned[i];
+    const result = p.tail.then(() => {
+      if (!p.worker || !p.worker.alive) p.worker = new GraderWorker(this.bin, this.args);
+      return p.worker.run(fields, timeoutMs);
+    });
+    p.tail = result.catch(() => {});
+    return result;
+  }
+
+  acquire() {
+    while (this.idle.length) {
+      const w = this.idle.pop();
+      if (w.alive) return Promise.resolve(w);
+      this.count--;
+    }
+    if (this.count < this.size) {
+      this.count++;
+      return Promise.resolve(new GraderWorker(this.bin, this.args));
+    }
+    return new Promise((resolve) => this.waiting.push(resolve));
+  }
+
+  release(w) {
+    if (!w.alive) {
+      this.count--;
+      if (this.waiting.length) {
+        this.count++;
+        this.waiting.shift()(new GraderWorker(this.bin, this.args));
+      }
+      return;
+    }
+    if (this.waiting.length) this.waiting.shift()(w);
+    else this.idle.push(w);
+  }
+
+  close() {
+    for (const w of this.idle) w.kill();
+    this.idle = [];
+    for (const p of this.pinned) if (p && p.worker) p.worker.kill();
+    this.pinned = [];
+  }
+}
+
+module.exports = { GraderPool };
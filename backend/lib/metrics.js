@@ -0,0 +1,105 @@
+/*
+  metrics.js
+
+  STATS line parsing and in-process aggregates for GET /metrics.
+
+  The C tools started with --stats end their stderr with one line
+    STATS {"tool":"...", ...numbers...}
+  splitStats() removes those lines from stderr and returns the parsed object, so
+  responses show stderr exactly as before and carry the numbers separately. A
+  regex2mindfa compilation stopped by a budget prints a BUDGET {...} line instead,
+  returned as budget.
+
+  Metrics keeps, per grading stage and per problem, run / error / timeout / budget
+  counts, server-side wall time, and the sum and maximum of every numeric stats field.
+*/
+
+function splitStats(stderr) {
+  let stats = null;
+  let budget = null;
+  const kept = [];
+  for (const line of String(stderr || "").split("\n")) {
+    const tag = line.startsWith("STATS {") ? "STATS" : line.startsWith("BUDGET {") ? "BUDGET" : null;
+    if (tag) {
+      try {
+        const v = JSON.parse(line.slice(tag.length + 1));
+        if (tag === "STATS") stats = v;
+        else budget = v;
+        continue;
+      } catch (_e) {
+        // not ours; leave it in stderr
+      }
+    }
+    kept.push(line);
+  }
+  return { stderr: kept.join("\n"), stats, budget };
+}
+
+function newBucket() {
+  return {
+    runs: 0,
+    errors: 0,
+    timeouts: 0,
+    budget_exceeded: 0,
+    wall_ms_total: 0,
+    wall_ms_max: 0,
+    stats_total: {},
+    stats_max: {}
+  };
+}
+
+function addTo(b, { wallMs, code, stats, budget }) {
+  b.runs++;
+  if (budget) b.budget_exceeded++;
+  else if (code === null) b.timeouts++;
+  else if (code !== 0) b.errors++;
+  b.wall_ms_total += wallMs;
+  if (wallMs > b.wall_ms_max) b.wall_ms_max = wallMs;
+  if (!stats) return;
+  for (const [k, v] of Object.entries(stats)) {
+    if (typeof v !== "number") continue;
+    b.stats_total[k] = (b.stats_total[k] || 0) + v;
+    if (!(k in b.stats_max) || v > b.stats_max[k]) b.stats_max[k] = v;
+  }
+}
+
+class Metrics {
+  constructor() {
+    this.started = Date.now();
+    this.requests = 0;
+    this.stages = new Map();
+    this.problems = new Map();
+  }
+
+  // One finished stage: code is the tool's exit code, null for a timeout; budget is the BUDGET line
+  record(problemId, stage, sample) {
+    if (!this.stages.has(stage)) this.stages.set(stage, newBucket());
+    addTo(this.stages.get(stage), sample);
+
+    if (!this.problems.has(problemId)) this.problems.set(problemId, { requests: 0, stages: new Map() });
+    const p = this.problems.get(problemId);
+    if (!p.stages.has(stage)) p.stages.set(stage, newBucket());
+    addTo(p.stages.get(stage), sample);
+  }
+
+  request(problemId) {
+    this.requests++;
+    if (!this.problems.has(problemId)) this.problems.set(problemId, { requests: 0, stages: new Map() });
+    this.problems.get(problemId).requests++;
+  }
+
+  snapshot() {
+    const problems = {};
+    for (const [id, p] of this.problems) {
+      problems[id] = { requests: p.requests, stages: Object.fromEntries(p.stages) };
+    }
+    return {
+      uptime_s: Math.round((Date.now() - this.started) / 1000),
+      requests: this.requests,
+      stages: Object.fromEntries(this.stages),
+      problems
+    };
+  }
+}
+
+module.exports = { Metrics, splitStats };
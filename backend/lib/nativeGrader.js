@@ -0,0 +1,59 @@
+/*
+  nativeGrader.js
+
+  The grader tools called in-process through the Node addon in backend/native
+  (npm run build:native). Each call runs on the libuv threadpool (UV_THREADPOOL_SIZE
+  threads, 4 by default) with its own copy of the tools' state.
+
+  NativeGrader has GraderPool's run(fields, { timeoutMs }) interface and result shape,
+  but a call is bounded by a step budget rather than a kill timeout: a call that runs
+  out of steps (or of regex2mindfa's other --max-* budgets) resolves with code null
+  and a stderr note, so callers treat it like a timeout. timeoutMs is ignored.
+
+  runPinned(slot, fields, opts) is GraderPool's too: calls for one slot run one after
+  another, in the order they were made. dfa_checker keeps its editor sessions in the
+  addon, shared by all threads, so that order is all a session needs.
+*/
+
+const STEPS_EXCEEDED_EXIT = 124; // automata.h
+
+function loadAddon() {
+  try {
+    return require("../native/build/Release/grader.node");
+  } catch (_e) {
+    return null;
+  }
+}
+
+class NativeGrader {
+  constructor(addon, tool, args, steps) {
+    this.addon = addon;
+    this.tool = tool;
+    this.flags = args.join(" ");
+    this.steps = steps;
+    this.pinned = new Map(); // slot -> tail of its queue
+  }
+
+  async run(fields, _opts) {
+    const r = await this.addon.run(this.tool, this.flags, fields, this.steps);
+    if (r.code === STEPS_EXCEEDED_EXIT) {
+      // regex2mindfa names the budget it ran out of in a BUDGET line
+      const note = /^BUDGET \{/m.test(r.stderr) ? "" : `\n[server] step budget of ${this.steps} exceeded`;
+      return { code: null, stdout: "", stderr: r.stderr + note };
+    }
+    return r;
+  }
+
+  runPinned(slot, fields, opts) {
+    const tail = this.pinned.get(slot) || Promise.resolve();
+    const result = tail.then(() => this.run(fields, opts));
+    const next = result.catch(() => {});
+    this.pinned.set(slot, next);
+    next.then(() => {
+      if (this.pinned.get(slot) === next) this.pinned.delete(slot);
+    });
+    return result;
+  }
+}
+
+module.exports = { NativeGrader, loadAddon };
@@ -0,0 +1,120 @@
+/*
+  problemCache.js
+
+  Reference artifacts per problem: the ref.txt contents, its compiled .dfa and the
+  tests.txt contents. Entries are keyed by problem ID plus the SHA-256 of ref.txt.
+
+  get() revalidates an entry with a stat() of both files. The reference is only
+  recompiled when ref.txt's content hash changes; a touched-but-identical file just
+  refreshes the stat. A failed compile is reported but not cached, so the next
+  request retries.
+*/
+const fsp = require("fs").promises;
+const path = require("path");
+const crypto = require("crypto");
+
+function normalizeAlphabetLine(line) {
+  // from ref line2 like: "a b 0 1" or "a,b,0,1" or "ab01" -> "ab01"
+  let s = "";
+  for (const ch of line) {
+    if (ch === "\n" || ch === "\r") continue;
+    if (ch === " " || ch === "\t" || ch === "," || ch === ";") continue;
+    s += ch;
+  }
+  if (!s) throw new Error("Empty alphabet in ref.txt");
+  return s;
+}
+
+function sameStat(a, b) {
+  return a && b && a.mtimeMs === b.mtimeMs && a.size === b.size && a.ino === b.ino;
+}
+
+class ProblemCache {
+  // compileRef(refTxt, problemId) must resolve with { code, stdout, stderr }, stdout being the .dfa text
+  constructor(problemsDir, compileRef) {
+    this.problemsDir = problemsDir;
+    this.compileRef = compileRef;
+    this.entries = new Map();
+    this.loading = new Map();
+  }
+
+  /*
+    Resolves with { compile, entry }. compile is the compile stage result (code 0
+    when the reference is usable, including cache hits); entry is set on success:
+      { problemId, key, refTxt, alphabetLine, alphabetString, refDfa, testsTxt, testsHash }
+  */
+  get(problemId) {
+    const inflight = this.loading.get(problemId);
+    if (inflight) return inflight;
+    const p = this.load(problemId).finally(() => this.loading.delete(problemId));
+    this.loading.set(problemId, p);
+    return p;
+  }
+
+  async load(problemId) {
+    const probDir = path.join(this.problemsDir, problemId);
+    const refPath = path.join(probDir, "ref.txt");
+    const testsPath = path.join(probDir, "tests.txt");
+
+    const [refStat, testsStat] = await Promise.all([fsp.stat(refPath), fsp.stat(testsPath)]);
+    const cached = this.entries.get(problemId);
+    if (cached && sameStat(cached.refStat, refStat) && sameStat(cached.testsStat, testsStat)) {
+      return { compile: { code: 0, stdout: "", stderr: "" }, entry: cached };
+    }
+
+    const refTxt = await fsp.readFile(refPath, "utf-8");
+    const hash = crypto.createHash("sha256").update(refTxt).digest("hex");
+
+    let entry;
+    if (cached && cached.hash === hash) {
+      entry = { ...cached, refStat };
+    } else {
+      const refLines = refTxt.split(/\r?\n/);
+      if (refLines.length < 2) throw new Error("Bad ref.txt format (need 2 lines)");
+      const alphabetLine = refLines[1];
+      const alphabetString = normalizeAlphabetLine(alphabetLine);
+
+      const compile = await this.compileRef(refTxt, problemId);
+      if (compile.code !== 0) return { compile, entry: null };
+
+      entry = {
+        problemId,
+        hash,
+        key: `${problemId}:${hash.slice(0, 16)}`,
+        refTxt,
+        alphabetLine,
+        alphabetString,
+        refDfa: compile.stdout,
+        refStat
+      };
+    }
+
+    if (cached && sameStat(cached.testsStat, testsStat)) {
+      entry.testsTxt = cached.testsTxt;
+      entry.testsHash = cached.testsHash;
+    } else {
+      entry.testsTxt = await fsp.readFile(testsPath, "utf-8");
+      entry.testsHash = crypto.createHash("sha256").update(entry.testsTxt).digest("hex");
+    }
+    entry.testsStat = testsStat;
+
+    this.entries.set(problemId, entry);
+    return { compile: { code: 0, stdout: "", stderr: "" }, entry };
+  }
+
+  // Compile every problem up front; failures are left for the first request to report.
+  async warm(isProblemId) {
+    let names = [];
+    try {
+      names = await fsp.readdir(this.problemsDir);
+    } catch (_e) {
+      return;
+    }
+    for (const name of names) {
+      if (!isProblemId(name)) continue;
+      await this.get(name).catch(() => {});
+    }
+  }
+}
+
+module.exports = { ProblemCache, normalizeAlphabetLine };
@@ -0,0 +1,115 @@
+/*
+  resultCache.js
+
+  Check results per submission, so an identical or merely renamed submission is
+  answered without running dfa_checker again.
+
+  The key is the SHA-256 of the problem's reference key, its tests, the check mode
+  and the canonical form of the user's .dfa text: states reachable from START,
+  renumbered in BFS order (symbols in alphabet order). regex2mindfa and
+  dfa2table --minimize already write minimized DFAs in that numbering, so equivalent
+  regexes and DFAs share one entry; an unminimized user DFA still loses its state
+  names, rule order and unreachable states.
+
+  Only exit codes 0 and 2 are stored (a verdict); errors and timeouts are always
+  rerun. Entries are evicted least recently used first.
+*/
+const crypto = require("crypto");
+
+// Canonical text of a text .dfa, or null when it does not parse
+function canonicalDfa(dfaText) {
+  const tok = String(dfaText).split(/\s+/).filter(Boolean);
+  let i = 0;
+  const word = (w) => tok[i++] === w;
+  const int = () => {
+    const v = Number(tok[i++]);
+    return Number.isInteger(v) && v >= 0 ? v : NaN;
+  };
+
+  if (!word("ALPHABET")) return null;
+  const k = int();
+  const alphabet = tok[i++];
+  if (!word("STATES")) return null;
+  const n = int();
+  if (!word("START")) return null;
+  const start = int();
+  if (!word("ACCEPT")) return null;
+  const m = int();
+  if (!(k >= 1 && n >= 1 && start < n && m <= n) || typeof alphabet !== "string") return null;
+  const acc = new Uint8Array(n);
+  for (let j = 0; j < m; j++) {
+    const a = int();
+    if (!(a < n)) return null;
+    acc[a] = 1;
+  }
+  if (!word("TRANS")) return null;
+  const trans = new Int32Array(n * k);
+  for (let j = 0; j < n * k; j++) {
+    const t = int();
+    if (!(t < n)) return null;
+    trans[j] = t;
+  }
+  if (!word("END")) return null;
+
+  const id = new Int32Array(n).fill(-1);
+  const order = [start];
+  id[start] = 0;
+  for (let h = 0; h < order.length; h++) {
+    const s = order[h];
+    for (let c = 0; c < k; c++) {
+      const t = trans[s * k + c];
+      if (id[t] < 0) {
+        id[t] = order.length;
+        order.push(t);
+      }
+    }
+  }
+
+  const rows = order.map((s) => Array.from(trans.subarray(s * k, (s + 1) * k), (t) => id[t]).join(" "));
+  const accepting = order.map((s, j) => (acc[s] ? j : -1)).filter((j) => j >= 0);
+  return `${alphabet}\n${order.length}\n${accepting.join(" ")}\n${rows.join("\n")}\n`;
+}
+
+class ResultCache {
+  constructor(maxEntries) {
+    this.maxEntries = maxEntries;
+    this.entries = new Map();
+    this.hits = 0;
+    this.misses = 0;
+  }
+
+  // Cache key for one check, or null when the submission cannot be cached
+  key(refKey, testsHash, checkMode, userDfa) {
+    if (this.maxEntries <= 0) return null;
+    const canon = canonicalDfa(userDfa);
+    if (canon === null) return null;
+    return crypto.createHash("sha256").update(`${refKey}\n${testsHash}\n${checkMode}\n${canon}`).digest("hex");
+  }
+
+  get(key) {
+    if (key === null) return undefined;
+    const r = this.entries.get(key);
+    if (r === undefined) {
+      this.misses++;
+      return undefined;
+    }
+    this.entries.delete(key);
+    this.entries.set(key, r);
+    this.hits++;
+    return r;
+  }
+
+  // r is the check stage result; only verdicts are kept
+  set(key, r) {
+    if (key === null || (r.code !== 0 && r.code !== 2)) return;
+    this.entries.delete(key);
+    this.entries.set(key, { code: r.code, stdout: r.stdout, stderr: r.stderr });
+    if (this.entries.size > this.maxEntries) this.entries.delete(this.entries.keys().next().value);
+  }
+
+  snapshot() {
+    return { entries: this.entries.size, max_entries: this.maxEntries, hits: this.hits, misses: this.misses };
+  }
+}
+
+module.exports = { ResultCache, canonicalDfa };
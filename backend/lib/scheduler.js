@@ -0,0 +1,143 @@
+/*
+  scheduler.js
+
+  Admission control for grading requests. At most `concurrency` jobs run at once;
+  the rest wait in one FIFO queue per client, and the queues are served round robin
+  so one client submitting in a loop cannot starve the others.
+
+  Jobs with the same key (the same submission to the same problem) share one run:
+  a request whose key is already queued or running gets that job's promise.
+
+  When the queue is full (maxQueued), or the client already has maxPerClient jobs
+  waiting, run() rejects at once with a BusyError carrying the HTTP status and the
+  position the job would have had, instead of letting every request time out.
+  retryAfterMs() estimates when that position would have been served from the
+  average run time of recent jobs.
+*/
+
+class BusyError extends Error {
+  constructor(status, position) {
+    super(status === 429 ? "Too many queued requests from this client" : "Server busy");
+    this.status = status;
+    this.position = position;
+  }
+}
+
+class Scheduler {
+  constructor({ concurrency, maxQueued, maxPerClient }) {
+    this.concurrency = Math.max(1, concurrency);
+    this.maxQueued = maxQueued;
+    this.maxPerClient = maxPerClient;
+    this.running = 0;
+    this.queued = 0;
+    this.queues = new Map(); // client -> jobs waiting, oldest first
+    this.turns = []; // clients with waiting jobs, in serving order
+    this.inflight = new Map(); // key -> promise
+    this.counts = { started: 0, deduped: 0, rejected: 0 };
+    this.avgRunMs = 0; // moving average over recent jobs
+  }
+
+  /*
+    Resolves with fn()'s result and the time spent waiting:
+      { value, queuedMs, position }   position is 0 for a job that started at once
+  */
+  run(client, key, fn) {
+    if (key !== null && this.inflight.has(key)) {
+      this.counts.deduped++;
+      return this.inflight.get(key);
+    }
+
+    const q = this.queues.get(client);
+    const position = this.running < this.concurrency && this.queued === 0 ? 0 : this.positionFor(client) + 1;
+    if (position > 0) {
+      if ((q ? q.length : 0) >= this.maxPerClient) {
+        this.counts.rejected++;
+        return Promise.reject(new BusyError(429, position));
+      }
+      if (this.queued >= this.maxQueued) {
+        this.counts.rejected++;
+        return Promise.reject(new BusyError(503, position));
+      }
+    }
+
+    const p = new Promise((resolve, reject) => {
+      const job = { fn, resolve, reject, enqueued: Date.now(), position };
+      if (position === 0) this.start(job);
+      else this.enqueue(client, job);
+    });
+    if (key !== null) {
+      this.inflight.set(key, p);
+      const clear = () => this.inflight.delete(key);
+      p.then(clear, clear);
+    }
+    return p;
+  }
+
+  // Jobs served before a new job of client, given round-robin turns
+  positionFor(client) {
+    const q = this.queues.get(client);
+    const mine = q ? q.length : 0;
+    let ahead = mine;
+    for (const [c, jobs] of this.queues) if (c !== client) ahead += Math.min(jobs.length, mine + 1);
+    return ahead;
+  }
+
+  enqueue(client, job) {
+    let q = this.queues.get(client);
+    if (!q) {
+      q = [];
+      this.queues.set(client, q);
+      this.turns.push(client);
+    }
+    q.push(job);
+    this.queued++;
+  }
+
+  start(job) {
+    this.running++;
+    this.counts.started++;
+    const t0 = Date.now();
+    const queuedMs = t0 - job.enqueued;
+    Promise.resolve()
+      .then(job.fn)
+      .then(
+        (value) => job.resolve({ value, queuedMs, position: job.position }),
+        (e) => job.reject(e)
+      )
+      .finally(() => {
+        const ms = Date.now() - t0;
+        this.avgRunMs = this.avgRunMs === 0 ? ms : 0.9 * this.avgRunMs + 0.1 * ms;
+        this.running--;
+        this.next();
+      });
+  }
+
+  next() {
+    while (this.running < this.concurrency && this.turns.length) {
+      const client = this.turns.shift();
+      const q = this.queues.get(client);
+      const job = q.shift();
+      this.queued--;
+      if (q.length) this.turns.push(client);
+      else this.queues.delete(client);
+      this.start(job);
+    }
+  }
+
+  retryAfterMs(position) {
+    return Math.ceil(position / this.concurrency) * Math.max(this.avgRunMs, 100);
+  }
+
+  snapshot() {
+    return {
+      concurrency: this.concurrency,
+      running: this.running,
+      queued: this.queued,
+      clients_waiting: this.queues.size,
+      avg_run_ms: Math.round(this.avgRunMs),
+      ...this.counts
+    };
+  }
+}
+
+module.exports = { Scheduler, BusyError };
@@ -0,0 +1,170 @@
+/*
+  sessions.js
+
+  Live checking for the DFA editor. A session holds the DFA being drawn as edits
+  arrive; the checker keeps its own copy in a pinned worker (dfa_checker --session),
+  so each edit request sends the worker only the changed lines.
+
+  Edit ops (JSON, state names are the editor's labels, symbols single characters):
+    { op: "start", state }                state null clears the start state
+    { op: "accept", state, accept: true | false }
+    { op: "trans", from, symbol, to }     to null or missing removes the transition
+
+  States are numbered in order of first use. Once MAX_STATES numbers are taken, the
+  numbers of states nothing refers to any more (not start or accepting, no
+  transitions in or out) are freed and handed out again; their rows in the checker
+  are already empty, so no edit is needed. The session also keeps the whole table
+  here, so when a worker has lost the session (restart or eviction) script() rebuilds
+  it from "reset" and the request is resent.
+*/
+const crypto = require("crypto");
+
+const MAX_STATES = 4096; // dfa_checker SESSION_MAX_STATES
+const MAX_LABEL = 64;
+
+class SessionStore {
+  constructor({ ttlMs, maxSessions }) {
+    this.ttlMs = ttlMs;
+    this.maxSessions = maxSessions;
+    this.sessions = new Map();
+    this.nextSlot = 0;
+  }
+
+  create(problemId, checkMode) {
+    this.sweep();
+    if (this.sessions.size >= this.maxSessions) {
+      // drop the least recently used one (Map order is refreshed by get)
+      this.sessions.delete(this.sessions.keys().next().value);
+    }
+    const s = {
+      id: crypto.randomBytes(12).toString("hex"),
+      problemId,
+      checkMode,
+      slot: this.nextSlot++,
+      states: new Map(),
+      nextState: 0,
+      free: [], // numbers of released states
+      start: -1,
+      accept: new Set(),
+      trans: new Map(),
+      synced: false, // the worker holds this session's table
+      lastUsed: Date.now()
+    };
+    this.sessions.set(s.id, s);
+    return s;
+  }
+
+  get(id) {
+    const s = this.sessions.get(id);
+    if (!s) return undefined;
+    if (Date.now() - s.lastUsed > this.ttlMs) {
+      this.sessions.delete(id);
+      return undefined;
+    }
+    s.lastUsed = Date.now();
+    this.sessions.delete(id);
+    this.sessions.set(id, s);
+    return s;
+  }
+
+  delete(id) {
+    this.sessions.delete(id);
+  }
+
+  sweep() {
+    const now = Date.now();
+    for (const [id, s] of this.sessions) if (now - s.lastUsed > this.ttlMs) this.sessions.delete(id);
+  }
+}
+
+function stateIndex(s, label) {
+  if (typeof label !== "string" || label.trim() === "" || label.length > MAX_LABEL) {
+    throw new Error("Invalid state name");
+  }
+  const name = label.trim();
+  let i = s.states.get(name);
+  if (i === undefined) {
+    if (s.nextState < MAX_STATES) i = s.nextState++;
+    else {
+      if (s.free.length === 0) releaseStates(s);
+      if (s.free.length === 0) throw new Error("Too many states");
+      i = s.free.pop();
+    }
+    s.states.set(name, i);
+  }
+  return i;
+}
+
+// Frees the numbers of the states nothing refers to
+function releaseStates(s) {
+  const used = new Set(s.accept);
+  if (s.start >= 0) used.add(s.start);
+  for (const [key, to] of s.trans) {
+    used.add(Number(key.slice(0, key.indexOf(" "))));
+    used.add(to);
+  }
+  for (const [name, i] of s.states) {
+    if (!used.has(i)) {
+      s.states.delete(name);
+      s.free.push(i);
+    }
+  }
+}
+
+/*
+  Validates ops and applies them to s; returns the checker edit lines. Throws on
+  the first bad op, leaving s as it was.
+*/
+function applyOps(s, ops, alphabetString) {
+  if (!Array.isArray(ops) || ops.length > 10000) throw new Error("Invalid ops");
+  const next = { ...s, states: new Map(s.states), free: [...s.free], accept: new Set(s.accept), trans: new Map(s.trans) };
+  const lines = [];
+  for (const o of ops) {
+    if (!o || typeof o !== "object") throw new Error("Invalid op");
+    if (o.op === "start") {
+      next.start = o.state === null ? -1 : stateIndex(next, o.state);
+      lines.push(next.start < 0 ? "s -" : `s ${next.start}`);
+    } else if (o.op === "accept") {
+      const q = stateIndex(next, o.state);
+      if (o.accept) next.accept.add(q);
+      else next.accept.delete(q);
+      lines.push(`a ${q} ${o.accept ? 1 : 0}`);
+    } else if (o.op === "trans") {
+      const from = stateIndex(next, o.from);
+      if (typeof o.symbol !== "string" || o.symbol.length !== 1 || !alphabetString.includes(o.symbol)) {
+        throw new Error(`Symbol not in alphabet: ${String(o.symbol)}`);
+      }
+      const key = `${from} ${o.symbol}`;
+      if (o.to === null || o.to === undefined) {
+        next.trans.delete(key);
+        lines.push(`t ${key} -`);
+      } else {
+        const to = stateIndex(next, o.to);
+        next.trans.set(key, to);
+        lines.push(`t ${key} ${to}`);
+      }
+    } else {
+      throw new Error(`Unknown op: ${String(o.op)}`);
+    }
+  }
+  Object.assign(s, {
+    states: next.states,
+    nextState: next.nextState,
+    free: next.free,
+    start: next.start,
+    accept: next.accept,
+    trans: next.trans
+  });
+  return lines;
+}
+
+// The whole table as an edit script from an empty session
+function script(s) {
+  const lines = ["reset"];
+  if (s.start >= 0) lines.push(`s ${s.start}`);
+  for (const q of s.accept) lines.push(`a ${q} 1`);
+  for (const [key, to] of s.trans) lines.push(`t ${key} ${to}`);
+  return lines;
+}
+
+module.exports = { SessionStore, applyOps, script };
@@ -0,0 +1,17 @@
+{
+  "targets": [
+    {
+      "target_name": "grader",
+      "sources": [
+        "grader.c",
+        "../c/automata.c",
+        "../c/regex2mindfa_compiler.c",
+        "../c/dfa2table.c",
+        "../c/dfa_checker.c"
+      ],
+      "defines": ["GRADER_LIBRARY"],
+      "cflags_c": ["-O2", "-std=c11", "-Wall", "-Wextra"],
+      "libraries": ["-lz", "-pthread"]
+    }
+  ]
+}
@@ -0,0 +1,181 @@
+/*
+  grader.c
+
+  PURPOSE
+    Node addon running regex2mindfa, dfa2table and dfa_checker requests in-process.
+    The tools are linked in with -DGRADER_LIBRARY (see "in-process requests" in
+    backend/c/automata.h); each call runs as async work on the libuv threadpool, so
+    it costs neither a process nor a pipe round trip and never blocks the event loop.
+
+  JS API
+    run(tool, flags, fields, steps) -> Promise<{ code, stdout, stderr }>
+      tool    "regex2mindfa" | "dfa2table" | "dfa_checker"
+      flags   the tool's command line flags as one string, e.g. "--stats --minimize"
+      fields  strings or Buffers, the tool's SERVE PROTOCOL request fields (three for
+              regex2mindfa --check)
+      steps   step budget of the call, 0 for none; an exhausted budget resolves with
+              code 124 (STEPS_EXCEEDED_EXIT)
+
+  BUILD
+    npm run build:native   (node-gyp, see binding.gyp)
+*/
+
+#define NAPI_VERSION 8
+
+#include <node_api.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../c/automata.h"
+
+#define MAX_FIELDS 5
+
+typedef int (*ToolCall)(const char* flags, char** fields, const size_t* lens, ToolOutput* o);
+
+/* nfields, and check_fields with --check */
+static const struct { const char* name; ToolCall call; int nfields, check_fields; } TOOLS[] = {
+    { "regex2mindfa", regex2mindfa_call, 1, 3 },
+    { "dfa2table",    dfa2table_call,    2, 2 },
+    { "dfa_checker",  dfa_checker_call,  5, 5 },
+};
+
+typedef struct {
+    napi_async_work work;
+    napi_deferred deferred;
+    ToolCall call;
+    char* flags;
+    int nf;
+    char* fields[MAX_FIELDS];
+    size_t lens[MAX_FIELDS];
+    long steps;
+    int code;
+    ToolOutput o;
+} Job;
+
+static void job_free(Job* j){
+    free(j->flags);
+    for(int i=0;i<j->nf;i++) free(j->fields[i]);
+    free(j->o.out);
+    free(j->o.err);
+    free(j);
+}
+
+/* NUL terminated copy of a string or Buffer value; NULL on a type error */
+static char* copy_value(napi_env env, napi_value v, size_t* len){
+    bool is_buf=false;
+    napi_is_buffer(env,v,&is_buf);
+    if(is_buf){
+        void* data=NULL;
+        if(napi_get_buffer_info(env,v,&data,len)!=napi_ok) return NULL;
+        char* s=malloc(*len+1);
+        if(!s) return NULL;
+        memcpy(s,data,*len);
+        s[*len]='\0';
+        return s;
+    }
+    if(napi_get_value_string_utf8(env,v,NULL,0,len)!=napi_ok) return NULL;
+    char* s=malloc(*len+1);
+    if(!s) return NULL;
+    napi_get_value_string_utf8(env,v,s,*len+1,len);
+    return s;
+}
+
+static void execute(napi_env env, void* data){
+    (void)env;
+    Job* j=(Job*)data;
+    steps_begin(j->steps);
+    j->code=j->call(j->flags,j->fields,j->lens,&j->o);
+    steps_begin(0);
+}
+
+static void complete(napi_env env, napi_status status, void* data){
+    Job* j=(Job*)data;
+    napi_value r, code, out, err;
+    napi_create_object(env,&r);
+    napi_create_int32(env,status==napi_ok ? j->code : 1,&code);
+    napi_create_string_utf8(env,j->o.out ? j->o.out : "",j->o.out_len,&out);
+    napi_create_string_utf8(env,j->o.err ? j->o.err : "",j->o.err_len,&err);
+    napi_set_named_property(env,r,"code",code);
+    napi_set_named_property(env,r,"stdout",out);
+    napi_set_named_property(env,r,"stderr",err);
+    napi_resolve_deferred(env,j->deferred,r);
+    napi_delete_async_work(env,j->work);
+    job_free(j);
+}
+
+static napi_value run(napi_env env, napi_callback_info info){
+    size_t argc=4;
+    napi_value argv[4];
+    napi_get_cb_info(env,info,&argc,argv,NULL,NULL);
+    if(argc<4){
+        napi_throw_type_error(env,NULL,"run(tool, flags, fields, steps)");
+        return NULL;
+    }
+
+    char name[32];
+    size_t name_len=0;
+    const int ntools=(int)(sizeof(TOOLS)/sizeof(TOOLS[0]));
+    int t=ntools;
+    if(napi_get_value_string_utf8(env,argv[0],name,sizeof(name),&name_len)==napi_ok){
+        for(t=0;t<ntools && strcmp(TOOLS[t].name,name)!=0;t++){}
+    }
+    if(t==ntools){
+        napi_throw_type_error(env,NULL,"unknown tool");
+        return NULL;
+    }
+
+    Job* j=calloc(1,sizeof(Job));
+    if(!j){
+        napi_throw_error(env,NULL,"out of memory");
+        return NULL;
+    }
+    j->call=TOOLS[t].call;
+    size_t flags_len=0;
+    j->flags=copy_value(env,argv[1],&flags_len);
+    if(!j->flags){
+        job_free(j);
+        napi_throw_type_error(env,NULL,"flags and fields must be strings or Buffers");
+        return NULL;
+    }
+    uint32_t nf=0;
+    bool is_array=false;
+    napi_is_array(env,argv[2],&is_array);
+    const int want = has_flag(j->flags,"--check") ? TOOLS[t].check_fields : TOOLS[t].nfields;
+    if(!is_array || napi_get_array_length(env,argv[2],&nf)!=napi_ok || nf!=(uint32_t)want){
+        job_free(j);
+        napi_throw_type_error(env,NULL,"wrong number of fields for this tool");
+        return NULL;
+    }
+    int64_t steps=0;
+    napi_get_value_int64(env,argv[3],&steps);
+    j->steps=(long)steps;
+    int ok=1;
+    for(uint32_t i=0;ok && i<nf;i++){
+        napi_value v;
+        napi_get_element(env,argv[2],i,&v);
+        j->fields[i]=copy_value(env,v,&j->lens[i]);
+        j->nf=(int)i+1;
+        ok = j->fields[i]!=NULL;
+    }
+    if(!ok){
+        job_free(j);
+        napi_throw_type_error(env,NULL,"flags and fields must be strings or Buffers");
+        return NULL;
+    }
+
+    napi_value promise, resource_name;
+    napi_create_promise(env,&j->deferred,&promise);
+    napi_create_string_utf8(env,"grader",NAPI_AUTO_LENGTH,&resource_name);
+    napi_create_async_work(env,NULL,resource_name,execute,complete,j,&j->work);
+    napi_queue_async_work(env,j->work);
+    return promise;
+}
+
+static napi_value init(napi_env env, napi_value exports){
+    napi_value fn;
+    napi_create_function(env,"run",NAPI_AUTO_LENGTH,run,NULL,&fn);
+    napi_set_named_property(env,exports,"run",fn);
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -1,25 +1,118 @@
 const express = require("express");
-const fs = require("fs");
-const fsp = fs.promises;
 const path = require("path");
 const os = require("os");
 const crypto = require("crypto");
 const { spawn } = require("child_process");
+const { GraderPool } = require("./lib/graderPool");
+const { ProblemCache } = require("./lib/problemCache");
+const { Metrics, splitStats } = require("./lib/metrics");
+const { ResultCache } = require("./lib/resultCache");
+const { SessionStore, applyOps, script } = require("./lib/sessions");
+const { Scheduler, BusyError } = require("./lib/scheduler");
+const { NativeGrader, loadAddon } = require("./lib/nativeGrader");
 
 const app = express();
 app.use(express.json({ limit: "64kb" }));
 
 const PORT = process.env.PORT || 8080;
 
-function runCmd(cmd, args, { cwd, timeoutMs }) {
+const BIN_DIR = path.join(__dirname, "bin");
+const MINDFA_BIN = path.join(BIN_DIR, "regex2mindfa");
+const CHECKER_BIN = path.join(BIN_DIR, "dfa_checker");
+const DFA2TABLE_BIN = path.join(BIN_DIR, "dfa2table");
+
+const envInt = (name, dflt) => (process.env[name] !== undefined ? Number(process.env[name]) : dflt);
+
+// Number of persistent `--serve` workers per tool; 0 falls back to spawning per stage.
+const GRADER_WORKERS =
+  process.env.GRADER_WORKERS !== undefined ? Number(process.env.GRADER_WORKERS) : os.cpus().length;
+
+// Tools run with --stats unless GRADER_STATS=0; the STATS lines feed responses and /metrics.
+const STATS_ARGS = process.env.GRADER_STATS === "0" ? [] : ["--stats"];
+
+// User DFAs are minimized by dfa2table unless DFA_MINIMIZE=0: smaller checker tables,
+// and an equivalent regex and DFA then share a result cache entry.
+const DFA2TABLE_ARGS = [...STATS_ARGS, ...(process.env.DFA_MINIMIZE === "0" ? [] : ["--minimize"])];
+
+// GRADER_NATIVE=1 calls the tools in-process through backend/native instead of worker
+// processes; a call then stops after GRADER_STEPS steps (about a second of subset
+// construction) rather than being killed at the stage timeout.
+const addon = process.env.GRADER_NATIVE === "1" ? loadAddon() : null;
+if (process.env.GRADER_NATIVE === "1" && !addon) {
+  console.warn("GRADER_NATIVE=1 but the addon is not built (npm run build:native); using worker processes");
+}
+const GRADER_STEPS = process.env.GRADER_STEPS !== undefined ? Number(process.env.GRADER_STEPS) : 5000000;
+
+// Budgets for compiling user regexes (regex2mindfa --max-*, 0 = none): a regex that
+// outgrows one stops within milliseconds with a BUDGET line instead of running into
+// the stage timeout, and is then graded lazily like a timeout. Worker processes also
+// get GRADER_STEPS as --max-steps; the reference regexes are compiled without budgets.
+const MINDFA_ARGS = [
+  ...STATS_ARGS,
+  ...["--max-nfa-states", envInt("GRADER_MAX_NFA_STATES", 0)],
+  ...["--max-dfa-states", envInt("GRADER_MAX_DFA_STATES", 200000)],
+  ...["--max-bytes", envInt("GRADER_MAX_BYTES", 256 << 20)]
+].map(String);
+const MINDFA_PROC_ARGS = [...MINDFA_ARGS, "--max-steps", String(GRADER_STEPS)];
+
+const pools = addon
+  ? {
+      mindfa: new NativeGrader(addon, "regex2mindfa", MINDFA_ARGS, GRADER_STEPS),
+      dfa2table: new NativeGrader(addon, "dfa2table", DFA2TABLE_ARGS, GRADER_STEPS),
+      checker: new NativeGrader(addon, "dfa_checker", STATS_ARGS, GRADER_STEPS),
+      lazy: new NativeGrader(addon, "regex2mindfa", [...STATS_ARGS, "--check"], GRADER_STEPS)
+    }
+  : GRADER_WORKERS > 0
+    ? {
+        mindfa: new GraderPool(MINDFA_BIN, GRADER_WORKERS, MINDFA_PROC_ARGS),
+        dfa2table: new GraderPool(DFA2TABLE_BIN, GRADER_WORKERS, DFA2TABLE_ARGS),
+        checker: new GraderPool(CHECKER_BIN, GRADER_WORKERS, STATS_ARGS)
+      }
+    : null;
+
+const metrics = new Metrics();
+
+// DFA editor sessions (see lib/sessions.js) run on pinned checker workers, also when
+// GRADER_WORKERS=0 replaces the pools; with GRADER_NATIVE=1 the addon keeps them.
+const sessions = new SessionStore({ ttlMs: 30 * 60 * 1000, maxSessions: 10000 });
+const sessionPool = pools ? pools.checker : new GraderPool(CHECKER_BIN, 1, STATS_ARGS);
+
+// Check verdicts per canonical user DFA (see lib/resultCache.js); RESULT_CACHE_SIZE=0 disables it.
+const results = new ResultCache(
+  process.env.RESULT_CACHE_SIZE !== undefined ? Number(process.env.RESULT_CACHE_SIZE) : 10000
+);
+
+// Grading admission (see lib/scheduler.js): GRADER_CONCURRENCY requests graded at once
+// (default the core count), at most GRADER_QUEUE waiting, GRADER_CLIENT_QUEUE per client.
+const scheduler = new Scheduler({
+  concurrency: envInt("GRADER_CONCURRENCY", os.cpus().length),
+  maxQueued: envInt("GRADER_QUEUE", 256),
+  maxPerClient: envInt("GRADER_CLIENT_QUEUE", 8)
+});
+
+/*
+  Spawns a tool with its inputs on pipes: inputs[0] is written to stdin and inputs[i]
+  to descriptor 2 + i, which the tool opens as /dev/fd/<2 + i> (see automata.h).
+  Nothing touches the disk; outputs come back on stdout.
+*/
+function runCmd(cmd, args, { inputs = [], timeoutMs }) {
   return new Promise((resolve) => {
-    const p = spawn(cmd, args, { cwd, stdio: ["ignore", "pipe", "pipe"] });
+    const stdio = ["pipe", "pipe", "pipe", ...inputs.slice(1).map(() => "pipe")];
+    const p = spawn(cmd, args, { stdio });
 
     let stdout = "";
     let stderr = "";
     p.stdout.on("data", (d) => (stdout += d.toString()));
     p.stderr.on("data", (d) => (stderr += d.toString()));
 
+    // A tool that fails early stops reading; its pipes then report EPIPE
+    inputs.forEach((data, i) => {
+      const w = p.stdio[i === 0 ? 0 : i + 2];
+      w.on("error", () => {});
+      w.end(data);
+    });
+    if (inputs.length === 0) p.stdin.end();
+
     const timer = setTimeout(() => {
       stderr += `\n[server] timeout after ${timeoutMs}ms`;
       p.kill("SIGKILL");
@@ -32,24 +125,123 @@ function runCmd(cmd, args, { cwd, timeoutMs }) {
   });
 }
 
+/*
+  Grading stages. Every stage resolves with { code, stdout, stderr }; for the two
+  compile stages stdout carries the .dfa text. With worker pools the data goes to
+  the tools' --serve workers; otherwise each stage spawns its tool with the data on
+  pipes. Either way nothing is written to disk.
+*/
+const stages = {
+  compileRegex(inputTxt, timeoutMs) {
+    if (pools) return pools.mindfa.run([inputTxt], { timeoutMs });
+    return runCmd(MINDFA_BIN, [...MINDFA_PROC_ARGS, "-", "-"], { inputs: [inputTxt], timeoutMs });
+  },
+
+  // Reference regexes are trusted and compiled once per change, without budgets
+  compileRef(refTxt, timeoutMs) {
+    return runCmd(MINDFA_BIN, [...STATS_ARGS, "-", "-"], { inputs: [refTxt], timeoutMs });
+  },
+
+  compileDfa(alphabetString, spec, timeoutMs) {
+    if (pools) return pools.dfa2table.run([alphabetString, spec], { timeoutMs });
+    return runCmd(DFA2TABLE_BIN, [...DFA2TABLE_ARGS, alphabetString, "-", "-"], { inputs: [spec], timeoutMs });
+  },
+
+  // refKey lets a checker worker reuse its parsed copy of the reference.
+  // checkMode "equiv" decides language equality exactly and ignores testsTxt;
+  // "report" checks every test and prints a JSON summary on stdout.
+  check(refKey, refDfa, userDfa, testsTxt, checkMode, timeoutMs) {
+    const equiv = checkMode === "equiv";
+    const opts = equiv ? ["--equiv"] : checkMode === "report" ? ["--report"] : [];
+    if (pools) {
+      return pools.checker.run([opts.join(" "), refKey, refDfa, userDfa, equiv ? "" : testsTxt], { timeoutMs });
+    }
+    if (equiv) {
+      return runCmd(CHECKER_BIN, [...STATS_ARGS, ...opts, "-", "/dev/fd/3"], { inputs: [refDfa, userDfa], timeoutMs });
+    }
+    return runCmd(CHECKER_BIN, [...STATS_ARGS, ...opts, "-", "/dev/fd/3", "/dev/fd/4"], {
+      inputs: [refDfa, userDfa, testsTxt],
+      timeoutMs
+    });
+  },
+
+  // Applies edit lines to the checker's copy of session s and checks the result. A worker
+  // that lost the session gets the whole table again.
+  async checkSession(s, refKey, refDfa, testsTxt, lines, timeoutMs) {
+    const opts = ["--session", s.id, ...(s.checkMode === "equiv" ? ["--equiv"] : s.checkMode === "report" ? ["--report"] : [])];
+    const send = (edit) =>
+      sessionPool.runPinned(s.slot, [opts.join(" "), refKey, refDfa, edit.join("\n") + "\n", s.checkMode === "equiv" ? "" : testsTxt], {
+        timeoutMs
+      });
+    let r = await send(s.synced ? lines : script(s));
+    if (r.code === 1 && s.synced && /^Error: session not found$/m.test(r.stderr)) r = await send(script(s));
+    s.synced = r.code === 0 || r.code === 2 || /^Error: session: no start state$/m.test(r.stderr);
+    return r;
+  },
+
+  // Same result as compileRegex + check on the tests, but regex2mindfa --check builds
+  // DFA states lazily, so a regex whose full DFA is too large can still be graded.
+  // In the addon it is bounded by the step budget rather than by timeoutMs.
+  checkRegexLazy(inputTxt, refDfa, testsTxt, timeoutMs) {
+    if (pools && pools.lazy) return pools.lazy.run([inputTxt, refDfa, testsTxt], { timeoutMs });
+    return runCmd(MINDFA_BIN, [...STATS_ARGS, "--check", "-", "/dev/fd/3", "/dev/fd/4"], {
+      inputs: [inputTxt, refDfa, testsTxt],
+      timeoutMs
+    });
+  }
+};
+
+/*
+  Runs one stage for /metrics: wall time, exit code (null on timeout) and the tool's
+  STATS line are recorded under the problem and stage name. The STATS line is moved
+  from stderr to r.stats, and a BUDGET line to r.budget (null when there is none).
+*/
+async function timedStage(problemId, stage, run) {
+  const t0 = process.hrtime.bigint();
+  const r = await run();
+  const wallMs = Number(process.hrtime.bigint() - t0) / 1e6;
+  const { stderr, stats, budget } = splitStats(r.stderr);
+  metrics.record(problemId, stage, { wallMs, code: r.code, stats, budget });
+  return { ...r, stderr, stats, budget };
+}
+
 function safeProblemId(problemId) {
   return /^P\d{3}$/.test(problemId);
 }
 
-function normalizeAlphabetLine(line) {
-  // from ref line2 like: "a b 0 1" or "a,b,0,1" or "ab01" -> "ab01"
-  let s = "";
-  for (const ch of line) {
-    if (ch === "\n" || ch === "\r") continue;
-    if (ch === " " || ch === "\t" || ch === "," || ch === ";") continue;
-    s += ch;
-  }
-  if (!s) throw new Error("Empty alphabet in ref.txt");
-  return s;
-}
+const REF_TIMEOUT_MS = 1500;
+
+// Compiled reference DFA per problem, recompiled only when ref.txt changes
+const problems = new ProblemCache(path.join(__dirname, "problems"), (refTxt, problemId) =>
+  timedStage(problemId, "compile_ref", () => stages.compileRef(refTxt, REF_TIMEOUT_MS))
+);
 
 app.get("/health", (_req, res) => res.json({ ok: true }));
 
+// Aggregates per stage and per problem since start-up (see lib/metrics.js)
+app.get("/metrics", (_req, res) =>
+  res.json({ ...metrics.snapshot(), result_cache: results.snapshot(), scheduler: scheduler.snapshot() })
+);
+
+/*
+  Runs grade() (resolving with { status, body }) through the scheduler and sends its
+  answer. Requests with the same key share one grading. When the queue is full the
+  answer is 503 (429 when this client's own queue is full) with Retry-After and
+  the queue position the request would have had.
+*/
+async function scheduled(req, res, problemId, key, grade) {
+  try {
+    const { value, queuedMs } = await scheduler.run(req.ip, key, grade);
+    if (queuedMs > 0) metrics.record(problemId, "queue", { wallMs: queuedMs, code: 0, stats: null });
+    return res.status(value.status).json(value.body);
+  } catch (e) {
+    if (!(e instanceof BusyError)) throw e;
+    const retryMs = scheduler.retryAfterMs(e.position);
+    res.set("Retry-After", String(Math.ceil(retryMs / 1000)));
+    return res.status(e.status).json({ ok: false, error: e.message, queuePosition: e.position, retryAfterMs: retryMs });
+  }
+}
+
 /*
 POST /api/run
 body:
@@ -57,99 +249,237 @@ body:
     problemId: "P001",
     mode: "regex" | "dfa",
     regex?: "...",
-    dfa?: "Start: q0\nAccept: {...}\n(q0,a)->q1\n..."
+    dfa?: "Start: q0\nAccept: {...}\n(q0,a)->q1\n...",
+    check?: "tests" | "report" | "equiv"
+      (default "tests", which stops at the first failing test; "report" checks every
+       test; "equiv" compares languages exactly)
   }
+  Responses carry the tools' STATS lines as stats (null when a tool printed none);
+  a failed stage's response has the stats of that stage.
+  A graded response has cached: true when the verdict came from the result cache
+  (the same canonical DFA was already checked for this problem); stats.check is
+  then null.
+  With check "equiv" a failing response also carries counterexample, a shortest
+  string ("" for the empty string) the user and reference DFAs disagree on.
+  With check "report" a graded response carries report, the checker's summary:
+    { tests, passed, failed, failures: [{ line, ref, user }], truncated, shortest: { line, w } | null }
+  In regex mode with check "tests" or "report", a regex whose DFA cannot be built
+  within the timeout or the compile budgets is graded by regex2mindfa --check
+  instead; that response has lazy: true and, as with "tests", only the first failing
+  test. A budget overrun is reported as budget, the BUDGET line of regex2mindfa:
+    { stage: "nfa" | "dfa" | "min", budget, limit, nfa_states, dfa_states, bytes, elapsed_ms }
+  (with check "equiv" it fails the compile_user_regex stage instead).
+  Requests wait their turn in the grading scheduler; when its queue is full the
+  answer is 503 (or 429 for a client with too many queued requests):
+    { ok: false, error, queuePosition, retryAfterMs }   with a Retry-After header
 */
-app.post("/api/run", async (req, res) => {
-  try {
-    const { problemId, mode } = req.body || {};
-    if (!safeProblemId(problemId)) {
-      return res.status(400).json({ ok: false, error: "Invalid problemId" });
-    }
-    const runMode = mode === "dfa" ? "dfa" : "regex";
 
-    const probDir = path.join(__dirname, "problems", problemId);
-    const refPath = path.join(probDir, "ref.txt");
-    const testsPath = path.join(probDir, "tests.txt");
+// Pulls "w = ..." out of the checker's --equiv FAIL report
+function parseCounterexample(stderr) {
+  const m = /^ {2}w = (.*)$/m.exec(stderr);
+  if (!m) return undefined;
+  return m[1] === "<eps>" ? "" : m[1];
+}
 
-    const refTxt = await fsp.readFile(refPath, "utf-8");
-    const refLines = refTxt.split(/\r?\n/);
-    if (refLines.length < 2) throw new Error("Bad ref.txt format (need 2 lines)");
+// The checker's --report JSON line, or undefined when it failed before printing one
+function parseReport(stdout) {
+  try {
+    return JSON.parse(stdout);
+  } catch (_e) {
+    return undefined;
+  }
+}
+// Grades one validated submission; resolves with the response { status, body }
+async function grade(problemId, runMode, checkMode, submission) {
+  const timeoutMs = 1500;
+  const reply = (body) => ({ status: 200, body });
 
-    const alphabetLine = refLines[1];
-    const alphabetString = normalizeAlphabetLine(alphabetLine);
+  // Reference DFA from the problem cache (keeps reference hidden server-side)
+  const { compile: r1, entry: prob } = await problems.get(problemId);
+  if (r1.code !== 0) {
+    return reply({ ok: false, stage: "compile_ref", ...r1 });
+  }
+  const { alphabetLine, alphabetString } = prob;
 
-    const runId = crypto.randomBytes(8).toString("hex");
-    const workDir = await fsp.mkdtemp(path.join(os.tmpdir(), `run-${runId}-`));
+  // Build user DFA depending on mode
+  const equiv = checkMode === "equiv";
+  let r2;
+  if (runMode === "regex") {
+    const inputTxt = `${submission}\n${alphabetLine}\n`;
+    r2 = await timedStage(problemId, "compile_user_regex", () => stages.compileRegex(inputTxt, timeoutMs));
+    if ((r2.code === null || r2.budget) && !equiv) {
+      const r3 = await timedStage(problemId, "check_lazy", () =>
+        stages.checkRegexLazy(inputTxt, prob.refDfa, prob.testsTxt, timeoutMs)
+      );
+      return reply({
+        ok: true,
+        mode: runMode,
+        check: checkMode,
+        lazy: true,
+        budget: r2.budget,
+        pass: r3.code === 0,
+        stage: "check",
+        stdout: r3.stdout,
+        stderr: r3.stderr,
+        stats: { compile: r2.stats, check: r3.stats }
+      });
+    }
+    if (r2.code !== 0) {
+      return reply({ ok: false, stage: "compile_user_regex", ...r2 });
+    }
+  } else {
+    r2 = await timedStage(problemId, "compile_user_dfa", () =>
+      stages.compileDfa(alphabetString, submission, timeoutMs)
+    );
+    if (r2.code !== 0) {
+      return reply({ ok: false, stage: "compile_user_dfa", ...r2 });
+    }
+  }
 
-    const refCopyPath = path.join(workDir, "ref.txt");
-    const testsCopyPath = path.join(workDir, "tests.txt");
-    await fsp.writeFile(refCopyPath, refTxt, "utf-8");
-    await fsp.copyFile(testsPath, testsCopyPath);
+  // Compare behavior on tests, or the languages themselves; a known submission reuses its verdict
+  const cacheKey = results.key(prob.key, prob.testsHash, checkMode, r2.stdout);
+  let r3 = results.get(cacheKey);
+  const cached = r3 !== undefined;
+  if (cached) {
+    metrics.record(problemId, "check_cached", { wallMs: 0, code: r3.code, stats: null });
+    r3 = { ...r3, stats: null };
+  } else {
+    r3 = await timedStage(problemId, "check", () =>
+      stages.check(prob.key, prob.refDfa, r2.stdout, prob.testsTxt, checkMode, timeoutMs)
+    );
+    results.set(cacheKey, r3);
+  }
 
-    const mindfa = path.join(__dirname, "bin", "regex2mindfa");
-    const checker = path.join(__dirname, "bin", "dfa_checker");
-    const dfa2table = path.join(__dirname, "bin", "dfa2table");
+  const body = {
+    ok: true,
+    mode: runMode,
+    check: checkMode,
+    pass: r3.code === 0,
+    stage: "check",
+    cached,
+    stdout: r3.stdout,
+    stderr: r3.stderr,
+    stats: { compile: r2.stats, check: r3.stats }
+  };
+  if (equiv && r3.code === 2) body.counterexample = parseCounterexample(r3.stderr);
+  if (checkMode === "report" && r3.code !== 1) body.report = parseReport(r3.stdout);
+  return reply(body);
+}
 
-    const timeoutMs = 1500;
+app.post("/api/run", async (req, res) => {
+  try {
+    const { problemId, mode } = req.body || {};
+    if (!safeProblemId(problemId)) {
+      return res.status(400).json({ ok: false, error: "Invalid problemId" });
+    }
+    const runMode = mode === "dfa" ? "dfa" : "regex";
+    const checkMode = ["equiv", "report"].includes(req.body.check) ? req.body.check : "tests";
 
-    // Compile reference DFA always (keeps reference hidden server-side)
-    const r1 = await runCmd(mindfa, [refCopyPath, path.join(workDir, "ref.dfa")], { cwd: workDir, timeoutMs });
-    if (r1.code !== 0) {
-      return res.status(200).json({ ok: false, stage: "compile_ref", ...r1 });
+    const submission = runMode === "regex" ? req.body.regex : req.body.dfa;
+    if (runMode === "regex" && (typeof submission !== "string" || submission.length < 1 || submission.length > 4000)) {
+      return res.status(400).json({ ok: false, error: "Invalid regex length" });
+    }
+    if (runMode === "dfa" && (typeof submission !== "string" || submission.length < 1 || submission.length > 20000)) {
+      return res.status(400).json({ ok: false, error: "Invalid DFA spec length" });
     }
+    metrics.request(problemId);
 
-    // Build user DFA depending on mode
-    if (runMode === "regex") {
-      const { regex } = req.body || {};
-      if (typeof regex !== "string" || regex.length < 1 || regex.length > 4000) {
-        return res.status(400).json({ ok: false, error: "Invalid regex length" });
-      }
-      const userPath = path.join(workDir, "user.txt");
-      await fsp.writeFile(userPath, `${regex}\n${alphabetLine}\n`, "utf-8");
+    // Identical concurrent submissions (double clicks, a class pasting one answer) grade once
+    const key = crypto
+      .createHash("sha256")
+      .update(`${problemId}\n${runMode}\n${checkMode}\n${submission}`)
+      .digest("hex");
+    return await scheduled(req, res, problemId, key, () => grade(problemId, runMode, checkMode, submission));
+  } catch (e) {
+    return res.status(500).json({ ok: false, error: String(e && e.message ? e.message : e) });
+  }
+});
 
-      const r2 = await runCmd(mindfa, [userPath, path.join(workDir, "user.dfa")], { cwd: workDir, timeoutMs });
-      if (r2.code !== 0) {
-        return res.status(200).json({ ok: false, stage: "compile_user_regex", ...r2 });
-      }
-    } else {
-      const { dfa } = req.body || {};
-      if (typeof dfa !== "string" || dfa.length < 1 || dfa.length > 20000) {
-        return res.status(400).json({ ok: false, error: "Invalid DFA spec length" });
-      }
-      const userSpecPath = path.join(workDir, "user_dfa.txt");
-      await fsp.writeFile(userSpecPath, dfa, "utf-8");
+/*
+DFA editor sessions (live checking while drawing):
+  POST   /api/session          { problemId, check?: "equiv" | "tests" | "report", ops? }
+                               -> { ok, sessionId } and, with ops, the check result
+  POST   /api/session/:id      { ops } -> check result
+  DELETE /api/session/:id
+  ops are edits to the session's DFA (lib/sessions.js). A check result has the
+  /api/run shape without mode; check defaults to "equiv", so a failing result carries
+  counterexample. A session without a start state yet answers ok: false with
+  stage "session". Sessions expire after 30 idle minutes.
+*/
+// Applies ops to session s and checks it; resolves with the response { status, body }
+async function sessionCheck(s, ops) {
+  const reply = (body) => ({ status: 200, body });
+  const { compile: r1, entry: prob } = await problems.get(s.problemId);
+  if (r1.code !== 0) return reply({ ok: false, stage: "compile_ref", ...r1 });
 
-      const r2 = await runCmd(dfa2table, [alphabetString, userSpecPath, path.join(workDir, "user.dfa")], {
-        cwd: workDir,
-        timeoutMs
-      });
-      if (r2.code !== 0) {
-        return res.status(200).json({ ok: false, stage: "compile_user_dfa", ...r2 });
-      }
-    }
+  let lines;
+  try {
+    lines = applyOps(s, ops, prob.alphabetString);
+  } catch (e) {
+    return { status: 400, body: { ok: false, error: e.message } };
+  }
+  const r = await timedStage(s.problemId, "session_check", () =>
+    stages.checkSession(s, prob.key, prob.refDfa, prob.testsTxt, lines, 1500)
+  );
+  if (r.code !== 0 && r.code !== 2) {
+    return reply({ ok: false, stage: "session", sessionId: s.id, ...r });
+  }
+  const body = {
+    ok: true,
+    sessionId: s.id,
+    check: s.checkMode,
+    pass: r.code === 0,
+    stage: "check",
+    stdout: r.stdout,
+    stderr: r.stderr,
+    stats: { check: r.stats }
+  };
+  if (s.checkMode === "equiv" && r.code === 2) body.counterexample = parseCounterexample(r.stderr);
+  if (s.checkMode === "report") body.report = parseReport(r.stdout);
+  return reply(body);
+}
 
-    // Compare behavior on tests
-    const r3 = await runCmd(checker, [path.join(workDir, "ref.dfa"), path.join(workDir, "user.dfa"), testsCopyPath], {
-      cwd: workDir,
-      timeoutMs
+app.post("/api/session", async (req, res) => {
+  try {
+    const { problemId, check, ops } = req.body || {};
+    if (!safeProblemId(problemId)) return res.status(400).json({ ok: false, error: "Invalid problemId" });
+    const checkMode = ["tests", "report"].includes(check) ? check : "equiv";
+    if (ops === undefined) return res.status(200).json({ ok: true, sessionId: sessions.create(problemId, checkMode).id });
+    return await scheduled(req, res, problemId, null, async () => {
+      // kept only when its first edits were applied (the reply names it)
+      const s = sessions.create(problemId, checkMode);
+      let r;
+      try {
+        r = await sessionCheck(s, ops);
+      } finally {
+        if (!r || !r.body.sessionId) sessions.delete(s.id);
+      }
+      return r;
     });
+  } catch (e) {
+    return res.status(500).json({ ok: false, error: String(e && e.message ? e.message : e) });
+  }
+});
 
-    // cleanup best-effort
-    fsp.rm(workDir, { recursive: true, force: true }).catch(() => {});
-
-    const pass = r3.code === 0;
-    return res.status(200).json({
-      ok: true,
-      mode: runMode,
-      pass,
-      stage: "check",
-      stdout: r3.stdout,
-      stderr: r3.stderr
-    });
+app.post("/api/session/:id", async (req, res) => {
+  try {
+    const s = sessions.get(req.params.id);
+    if (!s) return res.status(404).json({ ok: false, error: "Unknown session" });
+    return await scheduled(req, res, s.problemId, null, () => sessionCheck(s, (req.body || {}).ops));
   } catch (e) {
     return res.status(500).json({ ok: false, error: String(e && e.message ? e.message : e) });
   }
 });
 
-app.listen(PORT, () => console.log(`Backend listening on :${PORT}`));
+app.delete("/api/session/:id", (req, res) => {
+  const s = sessions.get(req.params.id);
+  if (!s) return res.status(404).json({ ok: false, error: "Unknown session" });
+  sessions.delete(s.id);
+  if (s.synced) sessionPool.runPinned(s.slot, [`--session ${s.id} --close`, "", "", "", ""], { timeoutMs: 1500 });
+  return res.status(200).json({ ok: true });
+});
+
+app.listen(PORT, () => {
+  console.log(`Backend listening on :${PORT}`);
+  problems.warm(safeProblemId);
+});
@@ -10,3 +10,25 @@ export async function run(payload: any) {
 
   return r.json();
 }
+
+async function post(path: string, payload: any) {
+  const base = process.env.NEXT_PUBLIC_API_BASE;
+  if (!base) throw new Error("Missing NEXT_PUBLIC_API_BASE");
+
+  const r = await fetch(`${base}${path}`, {
+    method: "POST",
+    headers: { "Content-Type": "application/json" },
+    body: JSON.stringify(payload),
+  });
+
+  return r.json();
+}
+
+// Live checking sessions for the DFA editor; ops come from diffGraphOps (lib/dfaEditor.ts).
+export function openSession(problemId: string, ops: any[]) {
+  return post("/api/session", { problemId, check: "equiv", ops });
+}
+
+export function editSession(sessionId: string, ops: any[]) {
+  return post(`/api/session/${sessionId}`, { ops });
+}
@@ -250,3 +250,51 @@ export function deleteStateCascade(graph: DfaGraph, stateId: string): DfaGraph {
     transitions: graph.transitions.filter((t) => t.from !== stateId && t.to !== stateId),
   };
 }
+
+export type DfaEditOp =
+  | { op: "start"; state: string | null }
+  | { op: "accept"; state: string; accept: boolean }
+  | { op: "trans"; from: string; symbol: string; to: string | null };
+
+type GraphModel = {
+  start: string | null;
+  accept: Set<string>;
+  trans: Map<string, { from: string; symbol: string; to: string }>;
+};
+
+function graphModel(graph: DfaGraph): GraphModel {
+  const labelById = new Map(graph.states.map((s) => [s.id, s.label.trim()]));
+  const starts = graph.states.filter((s) => s.isStart && s.label.trim());
+  const trans = new Map<string, { from: string; symbol: string; to: string }>();
+  for (const tr of graph.transitions) {
+    const from = labelById.get(tr.from);
+    const to = labelById.get(tr.to);
+    if (!from || !to) continue;
+    for (const symbol of normalizeSymbols(tr.symbols)) {
+      if (symbol.length === 1) trans.set(`${from}\u0000${symbol}`, { from, symbol, to });
+    }
+  }
+  return {
+    start: starts.length === 1 ? starts[0].label.trim() : null,
+    accept: new Set(graph.states.filter((s) => s.isAccept && s.label.trim()).map((s) => s.label.trim())),
+    trans,
+  };
+}
+
+// Edits that turn prev into next for a live checking session (prev EMPTY_GRAPH for a new one)
+export function diffGraphOps(prev: DfaGraph, next: DfaGraph): DfaEditOp[] {
+  const a = graphModel(prev);
+  const b = graphModel(next);
+  const ops: DfaEditOp[] = [];
+
+  if (b.start !== a.start) ops.push({ op: "start", state: b.start });
+  for (const s of a.accept) if (!b.accept.has(s)) ops.push({ op: "accept", state: s, accept: false });
+  for (const s of b.accept) if (!a.accept.has(s)) ops.push({ op: "accept", state: s, accept: true });
+  for (const [key, t] of a.trans) {
+    if (!b.trans.has(key)) ops.push({ op: "trans", from: t.from, symbol: t.symbol, to: null });
+  }
+  for (const [key, t] of b.trans) {
+    if (a.trans.get(key)?.to !== t.to) ops.push({ op: "trans", from: t.from, symbol: t.symbol, to: t.to });
+  }
+  return ops;
+}
@@ -5,11 +5,13 @@ import {
   DfaTransition,
   EMPTY_GRAPH,
   deleteStateCascade,
+  diffGraphOps,
   normalizeSymbols,
   parseDfaTextToGraph,
   serializeGraphToDfaText,
   validateGraph,
 } from "../lib/dfaEditor";
+import { editSession, openSession } from "../lib/api";
 
 type Tool = "select" | "add-state" | "add-transition" | "delete";
 
@@ -19,6 +21,14 @@ type EditorBootConfig = {
   problemId?: string;
 };
 
+type LiveResult = {
+  ok?: boolean;
+  pass?: boolean;
+  counterexample?: string;
+  stderr?: string;
+  error?: string;
+};
+
 type TransitionDialogState = {
   id: string | null;
   from: string;
@@ -95,8 +105,14 @@ export default function DfaEditorPage() {
   const [pendingTransitionFrom, setPendingTransitionFrom] = useState<string | null>(null);
   const [dialog, setDialog] = useState<TransitionDialogState | null>(null);
   const [errors, setErrors] = useState<string[]>([]);
+  const [live, setLive] = useState<LiveResult | null>(null);
 
   const canvasRef = useRef<HTMLDivElement | null>(null);
+  // live checking session: its id and the graph the server last accepted
+  const sessionRef = useRef<{ id: string | null; graph: DfaGraph }>({ id: null, graph: EMPTY_GRAPH });
+  // session requests run one at a time, in order; only the latest one shows its result
+  const sessionQueueRef = useRef<Promise<void>>(Promise.resolve());
+  const sessionSeqRef = useRef(0);
   const draggingRef = useRef<{ stateId: string; dx: number; dy: number } | null>(null);
 
   useEffect(() => {
@@ -155,6 +171,36 @@ export default function DfaEditorPage() {
   const selectedState = selectedStateId ? stateById.get(selectedStateId) ?? null : null;
   const validation = useMemo(() => validateGraph(graph, alphabet), [graph, alphabet]);
 
+  // Sends the edits since the last check to the session, a moment after editing stops
+  useEffect(() => {
+    if (!problemId) return;
+    const timer = window.setTimeout(() => {
+      const seq = ++sessionSeqRef.current;
+      sessionQueueRef.current = sessionQueueRef.current.then(async () => {
+        if (seq !== sessionSeqRef.current) return; // a newer edit is queued and sends this one too
+        const session = sessionRef.current;
+        const ops = diffGraphOps(session.graph, graph).filter(
+          (op) => op.op !== "trans" || alphabet.length === 0 || alphabet.includes(op.symbol)
+        );
+        if (session.id && ops.length === 0) return;
+        try {
+          let data = session.id ? await editSession(session.id, ops) : await openSession(problemId, ops);
+          if (data?.error === "Unknown session") {
+            sessionRef.current = { id: null, graph: EMPTY_GRAPH };
+            data = await openSession(problemId, diffGraphOps(EMPTY_GRAPH, graph));
+          }
+          if (data?.sessionId) {
+            sessionRef.current = { id: data.sessionId, graph };
+          }
+          if (seq === sessionSeqRef.current) setLive(data);
+        } catch (e: any) {
+          if (seq === sessionSeqRef.current) setLive({ ok: false, error: String(e?.message || e) });
+        }
+      });
+    }, 400);
+    return () => window.clearTimeout(timer);
+  }, [graph, problemId, alphabet]);
+
   function resetModes(nextTool: Tool) {
     setTool(nextTool);
     setPendingTransitionFrom(null);
@@ -469,6 +515,27 @@ export default function DfaEditorPage() {
             )}
           </div>
 
+          {problemId && (
+            <div className="panel sidePanel">
+              <h2>Live check</h2>
+              {!live && <div>Draw a DFA to compare it with the reference.</div>}
+              {live?.ok === true && live.pass && <div className="okBox">Equivalent to the reference.</div>}
+              {live?.ok === true && !live.pass && (
+                <ul className="errorList">
+                  <li>
+                    Not equivalent: the reference and your DFA disagree on{" "}
+                    {live.counterexample === "" ? "the empty string" : `"${live.counterexample}"`}.
+                  </li>
+                </ul>
+              )}
+              {live?.ok === false && (
+                <ul className="errorList">
+                  <li>{live.error || (live.stderr || "").replace(/^Error: (session: )?/, "")}</li>
+                </ul>
+              )}
+            </div>
+          )}
+
           <div className="panel sidePanel">
             <h2>Preview serialization</h2>
             <pre>
@@ -6,6 +6,15 @@ import { extractAlphabet } from "../../lib/dfaEditor";
 
 type Mode = "regex" | "dfa";
 
+type Report = {
+  tests: number;
+  passed: number;
+  failed: number;
+  failures: { line: number; ref: number; user: number }[];
+  truncated: boolean;
+  shortest: { line: number; w: string } | null;
+};
+
 type RunResult = {
   ok?: boolean;
   pass?: boolean;
@@ -13,6 +22,7 @@ type RunResult = {
   stdout?: string;
   stderr?: string;
   error?: string;
+  report?: Report;
 };
 
 const DFA_TEMPLATE = `Start: q0
@@ -59,8 +69,8 @@ export default function ProblemPage() {
     try {
       const payload =
         mode === "regex"
-          ? { problemId: problem.id, mode: "regex", regex }
-          : { problemId: problem.id, mode: "dfa", dfa };
+          ? { problemId: problem.id, mode: "regex", regex, check: "report" }
+          : { problemId: problem.id, mode: "dfa", dfa, check: "report" };
 
       const data = await run(payload);
       setResult(data);
@@ -225,7 +235,26 @@ export default function ProblemPage() {
           {result?.ok === true && (
             <>
               <div className="small" style={{ marginTop: 8 }}>Stage: <span className="kbd">{result.stage}</span></div>
-              {result.stdout && <><div style={{ marginTop: 12, fontWeight: 700 }}>stdout</div><pre>{result.stdout}</pre></>}
+              {result.report && (
+                <div style={{ marginTop: 12 }}>
+                  <div>
+                    Passed <b>{result.report.passed}</b> of {result.report.tests} tests.
+                  </div>
+                  {result.report.failed > 0 && (
+                    <div className="small" style={{ marginTop: 6 }}>
+                      Failing test lines: {result.report.failures.map((f) => f.line).join(", ")}
+                      {result.report.truncated && ` … (${result.report.failed} in total)`}
+                    </div>
+                  )}
+                  {result.report.shortest && (
+                    <div className="small" style={{ marginTop: 6 }}>
+                      Shortest failing string:{" "}
+                      <span className="kbd">{result.report.shortest.w === "" ? "<eps>" : result.report.shortest.w}</span>
+                    </div>
+                  )}
+                </div>
+              )}
+              {result.stdout && !result.report && <><div style={{ marginTop: 12, fontWeight: 700 }}>stdout</div><pre>{result.stdout}</pre></>}
               {result.stderr && <><div style={{ marginTop: 12, fontWeight: 700 }}>stderr</div><pre>{result.stderr}</pre></>}
             </>
           )}